@@ -11,21 +11,43 @@ CONFIG += c++20
 SOURCES += \
     ant.cpp \
     ant_sim.cpp \
+    bit_grid.cpp \
+    cave_cache.cpp \
+    cave_file.cpp \
     cave_gen.cpp \
+    cave_rule.cpp \
     custom_graphics_scene.cpp \
     main.cpp \
-    main_window.cpp
+    main_window.cpp \
+    pheromone_kernels.cpp \
+    region_labeler.cpp \
+    rock_tables.cpp \
+    tile_activity.cpp \
+    tile_frontier.cpp \
+    value_noise.cpp
 
 HEADERS += \
     ant.h \
     ant_sim.h \
+    bit_grid.h \
+    cave_cache.h \
+    cave_file.h \
     cave_gen.h \
+    cave_rule.h \
     cell.h \
     colors.h \
     custom_graphics_scene.h \
     grid.h \
     main_window.h \
-    sim_cell_data.h
+    parallel.h \
+    pheromone_kernels.h \
+    region_labeler.h \
+    rock_tables.h \
+    sim_cell_data.h \
+    sim_grid.h \
+    tile_activity.h \
+    tile_frontier.h \
+    value_noise.h
 
 FORMS += \
     main_window.ui
@@ -21,7 +21,7 @@ void Ant::move(int x, int y) {
 }
 
 Cell<SimCellData>
-Ant::pickDestination(const std::vector<Cell<SimCellData>> &candidates,
+Ant::pickDestination(std::span<const Cell<SimCellData>> candidates,
                      std::default_random_engine &rng) {
   // Choose the most appealing cell to move to
   Cell<SimCellData> destination = candidates[rng() % candidates.size()];
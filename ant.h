@@ -3,6 +3,7 @@
 
 #include "cell.h"
 #include "sim_cell_data.h"
+#include <span>
 
 /*
  * An ant capable of foraging behaviour in a grid.
@@ -107,7 +108,7 @@ public:
    * Pick the next cell to move to.
    */
   Cell<SimCellData>
-  pickDestination(const std::vector<Cell<SimCellData>> &candidates,
+  pickDestination(std::span<const Cell<SimCellData>> candidates,
                   std::default_random_engine &rng);
 
 private:
@@ -1,9 +1,248 @@
 #include "ant_sim.h"
+#include "pheromone_kernels.h"
 #include "sim_cell_data.h"
+#include <algorithm>
+#include <array>
+
+namespace {
+
+/*
+ * Offsets (dx, dy) of the cells ahead of a cell when facing one direction,
+ * in the order of Grid::visitDirectionalNeighbourhood.
+ */
+struct AheadOffsets {
+  int count;
+  std::array<std::pair<int, int>, 4> offsets;
+};
+
+/*
+ * Returns the offsets of the cells ahead for each direction (dx, dy), at
+ * index (dy + 1) * 3 + dx + 1.
+ */
+constexpr std::array<AheadOffsets, 9> aheadOffsets() {
+  std::array<AheadOffsets, 9> table{};
+  auto abs = [](int v) { return v < 0 ? -v : v; };
+
+  for (int dy = -1; dy <= 1; dy++) {
+    for (int dx = -1; dx <= 1; dx++) {
+      AheadOffsets &ahead = table[(dy + 1) * 3 + dx + 1];
+      for (int i = -1; i <= 1; i++) {
+        for (int j = -1; j <= 1; j++) {
+          if ((i != 0 || j != 0) && abs(i - dx) + abs(j - dy) <= 1)
+            ahead.offsets[ahead.count++] = {i, j};
+        }
+      }
+    }
+  }
+
+  return table;
+}
+
+constexpr std::array<AheadOffsets, 9> AHEAD_OFFSETS = aheadOffsets();
+
+} // namespace
 
 void AntSimulator::setup(Grid<SimCellData> grid) {
   reset();
+  Grid<SimCellData>::Precision precision = m_grid.getPrecision();
   m_grid = grid;
+  m_grid.setHalo(HALO);
+  m_grid.setPrecision(precision);
+  m_activity = TileActivity(m_grid.getRows(), m_grid.getCols());
+  m_tick = 0;
+  m_phTicks.assign(m_lazyEvaporation ? m_grid.getPlaneSize() : 0, 0);
+  m_refreshedTile = -1;
+  m_generation++;
+}
+
+Grid<SimCellData> AntSimulator::getGrid() const {
+  Grid<SimCellData> grid = m_grid;
+  if (!m_lazyEvaporation)
+    return grid;
+
+  // Inactive tiles hold no pheromones
+  for (int tile : m_activity.getActiveTiles()) {
+    TileActivity::Tile bounds = m_activity.getTile(tile);
+    int width = bounds.x1 - bounds.x0;
+
+    for (int y = bounds.y0; y < bounds.y1; y++) {
+      std::span<const uint32_t> ticks =
+          std::span(m_phTicks).subspan(grid.indexOf(bounds.x0, y), width);
+      if (isQuantized()) {
+        catchUpPheromones(grid.getHomeLevelRow(y).subspan(bounds.x0, width),
+                          grid.getFoodLevelRow(y).subspan(bounds.x0, width),
+                          ticks, m_tick,
+                          Grid<SimCellData>::toFixed(m_phDecay));
+      } else {
+        catchUpPheromones(
+            grid.getHomePheromoneRow(y).subspan(bounds.x0, width),
+            grid.getFoodPheromoneRow(y).subspan(bounds.x0, width), ticks,
+            m_tick, m_phDecay);
+      }
+    }
+  }
+
+  return grid;
+}
+
+QImage AntSimulator::renderTile(const Grid<SimCellData> &grid,
+                                TileActivity::Tile tile) {
+  QImage image(tile.x1 - tile.x0, tile.y1 - tile.y0, QImage::Format_RGB32);
+
+  for (int y = tile.y0; y < tile.y1; y++) {
+    QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y - tile.y0));
+    for (int x = tile.x0; x < tile.x1; x++)
+      line[x - tile.x0] = grid.getCell(x, y).getData().getColor().rgb();
+  }
+
+  return image;
+}
+
+void AntSimulator::setLazyEvaporation(bool lazy) {
+  materializePheromones();
+
+  // Steps are only counted per cell while evaporating lazily
+  if (lazy && !m_lazyEvaporation)
+    m_phTicks.assign(m_grid.getPlaneSize(), m_tick);
+  else if (!lazy)
+    std::vector<uint32_t>().swap(m_phTicks);
+
+  m_lazyEvaporation = lazy;
+}
+
+void AntSimulator::materializePheromones() {
+  if (m_lazyEvaporation)
+    updateActiveTiles();
+}
+
+void AntSimulator::updateActiveTiles() {
+  for (int tile : m_activity.getActiveTiles())
+    updateTile(tile);
+}
+
+void AntSimulator::updateTile(int tile) {
+  TileActivity::Tile bounds = m_activity.getTile(tile);
+  int width = bounds.x1 - bounds.x0;
+  bool anyLeft = false;
+
+  uint16_t rate = Grid<SimCellData>::toFixed(m_phDecay);
+
+  for (int y = bounds.y0; y < bounds.y1; y++) {
+    std::span<uint32_t> ticks =
+        std::span(m_phTicks).subspan(m_grid.indexOf(bounds.x0, y), width);
+
+    if (isQuantized()) {
+      std::span<uint16_t> home =
+          m_grid.getHomeLevelRow(y).subspan(bounds.x0, width);
+      std::span<uint16_t> food =
+          m_grid.getFoodLevelRow(y).subspan(bounds.x0, width);
+      anyLeft |= m_lazyEvaporation
+                     ? catchUpPheromones(home, food, ticks, m_tick, rate)
+                     : evaporatePheromones(home, food, rate);
+    } else {
+      std::span<float> home =
+          m_grid.getHomePheromoneRow(y).subspan(bounds.x0, width);
+      std::span<float> food =
+          m_grid.getFoodPheromoneRow(y).subspan(bounds.x0, width);
+      anyLeft |= m_lazyEvaporation
+                     ? catchUpPheromones(home, food, ticks, m_tick, m_phDecay)
+                     : evaporatePheromones(home, food, m_phDecay);
+    }
+
+    if (m_lazyEvaporation)
+      std::ranges::fill(ticks, m_tick);
+  }
+
+  m_activity.markDirty(tile);
+  if (!anyLeft && !hasPopulation(bounds))
+    m_activity.deactivate(tile);
+}
+
+void AntSimulator::refreshNest(TileActivity::Tile bounds) {
+  m_grid.visitNeumannNeighbourhood(m_nestX, m_nestY, 2, [&](int x, int y) {
+    if (x < bounds.x0 || x >= bounds.x1 || y < bounds.y0 || y >= bounds.y1)
+      return;
+
+    materializePheromones(m_grid.indexOf(x, y));
+    addPheromone(m_grid.indexOf(x, y), false,
+                 SimCellData::depositWeight(1.0f, 0, 0));
+    touch(x, y);
+  });
+}
+
+std::vector<AntSimulator::TileImage> AntSimulator::sweepActiveTiles() {
+  TileActivity::Tile grid{0, 0, m_grid.getCols(), m_grid.getRows()};
+  if (m_lazyEvaporation) {
+    // Lazily evaporated levels are stamped with the step, so the nest must be
+    // refreshed before moving to the next one
+    refreshNest(grid);
+    m_tick++;
+  } else {
+    // The tiles around the nest must be active to be swept
+    touch(m_nestX, m_nestY, 2);
+  }
+
+  std::vector<int> tiles = m_lazyEvaporation ? nextLazyTiles()
+                                             : m_activity.getActiveTiles();
+  std::vector<TileImage> images;
+  for (int tile : tiles) {
+    TileActivity::Tile bounds = m_activity.getTile(tile);
+    if (!m_lazyEvaporation)
+      refreshNest(bounds);
+
+    updateTile(tile);
+    images.push_back({tile, renderTile(m_grid, bounds)});
+    m_activity.markClean(tile);
+  }
+
+  // Tiles cleared since the last step are no longer active
+  for (TileImage &image : renderDirtyTiles())
+    images.push_back(std::move(image));
+
+  m_stepPrepared = true;
+  return images;
+}
+
+std::vector<int> AntSimulator::nextLazyTiles() {
+  std::vector<int> tiles = m_activity.getDirtyTiles();
+  std::vector<int> active = m_activity.getActiveTiles();
+
+  // The other active tiles take turns, so that their trails keep fading on
+  // screen and they become inactive once empty
+  auto next = std::ranges::upper_bound(active, m_refreshedTile);
+  int count = std::min<int>(LAZY_REFRESH_TILES, active.size());
+  for (int k = 0; k < count; k++) {
+    if (next == active.end())
+      next = active.begin();
+    m_refreshedTile = *next++;
+    tiles.push_back(m_refreshedTile);
+  }
+
+  std::ranges::sort(tiles);
+  tiles.erase(std::unique(tiles.begin(), tiles.end()), tiles.end());
+  return tiles;
+}
+
+bool AntSimulator::hasPopulation(TileActivity::Tile tile) const {
+  for (int y = tile.y0; y < tile.y1; y++) {
+    std::span<const uint8_t> types = m_grid.getTypeRow(y);
+    for (int x = tile.x0; x < tile.x1; x++) {
+      if (types[x] == SimCellData::Type::ANT ||
+          types[x] == SimCellData::Type::FOOD ||
+          types[x] == SimCellData::Type::NEST)
+        return true;
+    }
+  }
+
+  return false;
+}
+
+std::vector<AntSimulator::TileImage> AntSimulator::renderDirtyTiles() {
+  std::vector<TileImage> images;
+  for (int tile : m_activity.takeDirtyTiles())
+    images.push_back({tile, renderTile(m_grid, m_activity.getTile(tile))});
+
+  return images;
 }
 
 void AntSimulator::initialize() {
@@ -13,14 +252,13 @@ void AntSimulator::initialize() {
   do {
     m_nestX = m_rng() % m_grid.getCols();
     m_nestY = m_rng() % m_grid.getRows();
-  } while (m_grid.getCell(m_nestX, m_nestY).getData().getType() ==
+  } while (m_grid.typeAt(m_grid.indexOf(m_nestX, m_nestY)) ==
            SimCellData::Type::ROCK);
 
-  SimCellData tmp = m_grid.getCell(m_nestX, m_nestY).getData();
-  tmp.setType(SimCellData::Type::NEST);
-  m_grid.setCell(m_nestX, m_nestY, tmp);
+  m_grid.typeAt(m_grid.indexOf(m_nestX, m_nestY)) = SimCellData::Type::NEST;
+  touch(m_nestX, m_nestY);
 
-  emit gridReady(m_grid);
+  emit gridReady(getGrid(), m_generation);
   emit initialized();
 }
 
@@ -36,61 +274,62 @@ void AntSimulator::step() {
   while (m_ants.size() > m_maxAnts) {
     int victimIndex = m_rng() % m_ants.size();
     const Ant &toRemove = m_ants[victimIndex];
-    SimCellData data =
-        m_grid.getCell(toRemove.getX(), toRemove.getY()).getData();
-    data.setType(SimCellData::Type::FLOOR);
-    m_grid.setCell(toRemove.getX(), toRemove.getY(), data);
+    m_grid.typeAt(m_grid.indexOf(toRemove.getX(), toRemove.getY())) =
+        SimCellData::Type::FLOOR;
+    touch(toRemove.getX(), toRemove.getY());
     m_ants.erase(m_ants.begin() + victimIndex);
   }
 
-  // Update nest pheromone
-  std::vector<Cell<SimCellData>> nestArea =
-      m_grid.getNeumannNeighbourhood(m_nestX, m_nestY, 2);
-  for (Cell<SimCellData> cell : nestArea) {
-    SimCellData data = cell.getData();
-    data.incrementHomePheromone(1.0f, 0, 0);
-    m_grid.setCell(cell.getX(), cell.getY(), data);
-  }
+  // The sweep ending a fused step already prepared the pheromones
+  if (!m_stepPrepared) {
+    // Update nest pheromone
+    refreshNest({0, 0, m_grid.getCols(), m_grid.getRows()});
 
-  // Simulate pheromone evaporation
-  for (int x = 0; x < m_grid.getCols(); x++) {
-    for (int y = 0; y < m_grid.getRows(); y++) {
-      SimCellData tmp = m_grid.getCell(x, y).getData();
-      tmp.decrementPheromones(m_phDecay);
-      m_grid.setCell(x, y, tmp);
-    }
+    // Simulate pheromone evaporation on the tiles that may hold pheromones,
+    // which lazy evaporation defers until the cells are used or drawn
+    if (m_lazyEvaporation)
+      m_tick++;
+    else
+      updateActiveTiles();
   }
 
   // Move ants
   for (Ant &ant : m_ants) {
-    std::vector<Cell<SimCellData>> neighbourhood =
-        m_grid.getDirectionalNeighbourhood(ant.getX(), ant.getY(),
-                                           ant.getDirection());
-
-    // We don't consider occupied cells
-    std::erase_if(neighbourhood, [&](Cell<SimCellData> cell) {
-      return cell.getData().getType() == SimCellData::Type::ROCK ||
-             cell.getData().getType() == SimCellData::Type::ANT ||
-             (ant.hasFood() &&
-              cell.getData().getType() == SimCellData::Type::FOOD);
-    });
+    // Gather the cells ahead of the ant, not considering occupied ones.
+    // Halo cells are rock, so the cells ahead need no bounds checks.
+    std::array<Cell<SimCellData>, 8> candidates;
+    size_t candidateCount = 0;
+    std::pair<int, int> d = ant.getDirection();
+    const AheadOffsets &ahead = AHEAD_OFFSETS[(d.second + 1) * 3 + d.first + 1];
+    int i = m_grid.indexOf(ant.getX(), ant.getY());
+    for (int k = 0; k < ahead.count; k++) {
+      auto [dx, dy] = ahead.offsets[k];
+      int j = i + m_grid.offsetOf(dx, dy);
+      materializePheromones(j);
+      uint8_t type = m_grid.typeAt(j);
+      if (type != SimCellData::Type::ROCK && type != SimCellData::Type::ANT &&
+          (!ant.hasFood() || type != SimCellData::Type::FOOD))
+        candidates[candidateCount++] =
+            m_grid.getCell(ant.getX() + dx, ant.getY() + dy);
+    }
 
     // No suitable neighbouring cells to move to
-    if (neighbourhood.empty()) {
+    if (candidateCount == 0) {
       ant.invert();
       continue;
     }
 
-    Cell<SimCellData> destination = ant.pickDestination(neighbourhood, m_rng);
+    Cell<SimCellData> destination = ant.pickDestination(
+        std::span(candidates.data(), candidateCount), m_rng);
 
     // Restore the previous cell
-    SimCellData tmp = m_grid.getCell(ant.getX(), ant.getY()).getData();
+    uint8_t &previous = m_grid.typeAt(m_grid.indexOf(ant.getX(), ant.getY()));
     if (ant.getX() == m_nestX && ant.getY() == m_nestY)
-      tmp.setType(SimCellData::Type::NEST);
+      previous = SimCellData::Type::NEST;
     else {
-      tmp.setType(SimCellData::Type::FLOOR);
+      previous = SimCellData::Type::FLOOR;
     }
-    m_grid.setCell(ant.getX(), ant.getY(), tmp);
+    touch(ant.getX(), ant.getY());
     spreadPheromone(ant);
 
     // Update the ant
@@ -112,31 +351,74 @@ void AntSimulator::step() {
     }
 
     // Update the grid
-    tmp = m_grid.getCell(destination.getX(), destination.getY()).getData();
-    tmp.setType(SimCellData::Type::ANT);
-    m_grid.setCell(destination.getX(), destination.getY(), tmp);
+    m_grid.typeAt(m_grid.indexOf(destination.getX(), destination.getY())) =
+        SimCellData::Type::ANT;
+    touch(destination.getX(), destination.getY());
   }
 
-  emit gridReady(m_grid);
+  if (m_deposition == BATCHED)
+    applyDeposits();
+
+  if (m_fusedStep) {
+    emit tilesReady(sweepActiveTiles(), m_generation);
+    return;
+  }
+
+  // Only the tiles that changed are drawn again, after catching up with
+  // the steps their pheromones missed
+  m_stepPrepared = false;
+  if (m_lazyEvaporation) {
+    for (int tile : nextLazyTiles())
+      updateTile(tile);
+  }
+
+  emit tilesReady(renderDirtyTiles(), m_generation);
 }
 
 void AntSimulator::spreadPheromone(Ant ant) {
-  std::vector<Cell<SimCellData>> neighbourhood =
-      m_grid.getNeumannNeighbourhood(ant.getX(), ant.getY(), m_phSpread);
-  neighbourhood.push_back(m_grid.getCell(ant.getX(), ant.getY()));
+  int traveled = ant.getTraveledDistance();
+  bool food = ant.getMode() == Ant::RETURN && ant.hasFood();
+  if (!food && ant.getMode() != Ant::SEEK)
+    return;
 
-  for (Cell<SimCellData> cell : neighbourhood) {
-    SimCellData data = cell.getData();
-    // Pheromone strength decreases with distance from the source
-    int distFromSource =
-        m_grid.manhattanDist(cell.getX(), cell.getY(), ant.getX(), ant.getY());
-    if (ant.getMode() == Ant::RETURN && ant.hasFood())
-      data.incrementFoodPheromone(m_phStrength, distFromSource,
-                                  ant.getTraveledDistance());
-    else if (ant.getMode() == Ant::SEEK)
-      data.incrementHomePheromone(m_phStrength, distFromSource,
-                                  ant.getTraveledDistance());
-    m_grid.setCell(cell.getX(), cell.getY(), data);
+  touch(ant.getX(), ant.getY(), m_phSpread);
+  if (m_deposition == BATCHED) {
+    m_deposits.push_back({ant.getX(), ant.getY(), traveled, food});
+    return;
+  }
+
+  // Pheromone strength decreases with distance from the source
+  visitDeposit(ant.getX(), ant.getY(), [&](int j, int distance) {
+    materializePheromones(j);
+    addPheromone(j, food, m_stencil.getWeight(distance, traveled));
+  });
+}
+
+void AntSimulator::applyDeposits() {
+  // A step deposits at most a few thousand weights, which takes less time
+  // than starting a thread, so they are weighted on this thread
+  std::vector<CellDeposit> weights;
+  for (const Deposit &deposit : m_deposits) {
+    visitDeposit(deposit.x, deposit.y, [&](int j, int distance) {
+      float weight = m_stencil.getWeight(distance, deposit.traveled);
+      weights.push_back({j, deposit.food, weight});
+    });
+  }
+  m_deposits.clear();
+
+  // Sorting stably keeps the sums in the order of the ants
+  std::ranges::stable_sort(weights, {}, &CellDeposit::index);
+
+  for (size_t k = 0; k < weights.size();) {
+    int i = weights[k].index;
+    float home = 0.0f;
+    float food = 0.0f;
+    for (; k < weights.size() && weights[k].index == i; k++)
+      (weights[k].food ? food : home) += weights[k].amount;
+
+    materializePheromones(i);
+    addPheromone(i, false, home);
+    addPheromone(i, true, food);
   }
 }
 
@@ -144,23 +426,22 @@ void AntSimulator::onCellClicked(int x, int y) {
   if (x < 0 || x >= m_grid.getCols() || y < 0 || y >= m_grid.getRows())
     return;
 
-  std::vector<Cell<SimCellData>> neighbourhood =
-      m_grid.getNeumannNeighbourhood(x, y, 2);
-  neighbourhood.push_back(m_grid.getCell(x, y));
-
   // Place food
-  for (Cell<SimCellData> cell : neighbourhood) {
-    SimCellData data = cell.getData();
-    if (data.getType() == SimCellData::FLOOR) {
-      data.setType(SimCellData::Type::FOOD);
-      m_grid.setCell(cell.getX(), cell.getY(), data);
+  auto placeFood = [&](int i, int j) {
+    uint8_t &type = m_grid.typeAt(m_grid.indexOf(i, j));
+    if (type == SimCellData::FLOOR) {
+      type = SimCellData::Type::FOOD;
+      touch(i, j);
 
       m_totalFood++;
       emit updateFoodCount(m_deliveredFood, m_totalFood);
     }
-  }
+  };
+
+  m_grid.visitNeumannNeighbourhood(x, y, 2, placeFood);
+  placeFood(x, y);
 
-  emit gridReady(m_grid);
+  emit tilesReady(renderDirtyTiles(), m_generation);
 }
 
 void AntSimulator::setMaxAntSteps(int m) {
@@ -174,19 +455,37 @@ void AntSimulator::reset() {
   m_nestX = -1;
   m_nestY = -1;
   m_ants.clear();
+  m_stepPrepared = false;
 
-  // Clears pheromones
-  for (int x = 0; x < m_grid.getCols(); x++) {
-    for (int y = 0; y < m_grid.getRows(); y++) {
-      SimCellData tmp = m_grid.getCell(x, y).getData();
-      if (tmp.getType() == SimCellData::Type::ANT ||
-          tmp.getType() == SimCellData::Type::NEST ||
-          tmp.getType() == SimCellData::Type::FOOD)
-        tmp.setType(SimCellData::Type::FLOOR);
-
-      tmp.clearPheromones();
-      m_grid.setCell(x, y, tmp);
+  // Population and pheromones can only be found on active tiles
+  for (int tile : m_activity.getActiveTiles()) {
+    TileActivity::Tile bounds = m_activity.getTile(tile);
+    int width = bounds.x1 - bounds.x0;
+
+    for (int y = bounds.y0; y < bounds.y1; y++) {
+      // Clears the population
+      for (uint8_t &type : m_grid.getTypeRow(y).subspan(bounds.x0, width)) {
+        if (type == SimCellData::Type::ANT ||
+            type == SimCellData::Type::NEST || type == SimCellData::Type::FOOD)
+          type = SimCellData::Type::FLOOR;
+      }
+
+      // Clears pheromones
+      if (isQuantized()) {
+        std::ranges::fill(m_grid.getHomeLevelRow(y).subspan(bounds.x0, width),
+                          0);
+        std::ranges::fill(m_grid.getFoodLevelRow(y).subspan(bounds.x0, width),
+                          0);
+      } else {
+        std::ranges::fill(
+            m_grid.getHomePheromoneRow(y).subspan(bounds.x0, width), 0.0f);
+        std::ranges::fill(
+            m_grid.getFoodPheromoneRow(y).subspan(bounds.x0, width), 0.0f);
+      }
     }
+
+    m_activity.markDirty(tile);
+    m_activity.deactivate(tile);
   }
 }
 
@@ -194,5 +493,10 @@ void AntSimulator::resetParams() {
   m_maxAnts = 20;
   m_phStrength = 1.0f;
   m_phSpread = 2;
+  updateStencil();
+  setLazyEvaporation(false);
+  m_deposition = SEQUENTIAL;
+  m_fusedStep = false;
+  setQuantized(false);
   m_phDecay = 0.01f;
 }
@@ -2,9 +2,15 @@
 #define ANT_SIM_H
 
 #include "ant.h"
-#include "grid.h"
-#include "sim_cell_data.h"
+#include "pheromone_kernels.h"
+#include "sim_grid.h"
+#include "tile_activity.h"
+#include <QImage>
 #include <QObject>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
 
 /*
  * Simulates the behaviour of a colony of ants foraging for food.
@@ -13,14 +19,30 @@ class AntSimulator : public QObject {
   Q_OBJECT
 
 public:
+  /*
+   * Image of the tile with index `tile` of the grid, one pixel per cell.
+   */
+  struct TileImage {
+    int tile;
+    QImage image;
+  };
+
+  /*
+   * Ways of depositing the pheromones of the moving ants: each ant right
+   * after it moves, or every ant at once at the end of the step, so that all
+   * ants read the pheromone levels the step started with.
+   */
+  enum Deposition { SEQUENTIAL, BATCHED };
+
   /*
    * Construct the simulator with the specified seed for random number
    * generation.
    */
-  AntSimulator(int seed = 0) : m_seed(seed), m_rng(seed){};
+  AntSimulator(int seed = 0) : m_seed(seed), m_rng(seed) { updateStencil(); };
 
   /*
-   * Set the simulation grid.
+   * Set the simulation grid. Must be called from the simulator's thread, as
+   * it replaces the grid and the tiles the steps work on.
    */
   void setup(Grid<SimCellData> grid);
 
@@ -85,6 +107,45 @@ public:
    */
   std::pair<int, int> getPhDecayRange() { return {0, 100}; }
 
+  /*
+   * Returns true if pheromones evaporate lazily.
+   */
+  bool isEvaporatingLazily() const { return m_lazyEvaporation; }
+
+  /*
+   * Returns the way pheromones are deposited.
+   */
+  Deposition getDeposition() const { return m_deposition; }
+
+  /*
+   * Returns true if steps end with a fused sweep of the active tiles.
+   */
+  bool isStepFused() const { return m_fusedStep; }
+
+  /*
+   * Returns true if pheromones are stored as 16-bit fixed-point levels.
+   */
+  bool isQuantized() const {
+    return m_grid.getPrecision() == Grid<SimCellData>::FIXED16;
+  }
+
+  /*
+   * Returns the number of grids set up so far, which tags the tiles of each
+   * grid.
+   */
+  int getGeneration() const { return m_generation; }
+
+  /*
+   * Returns a copy of the simulation grid with up to date pheromone levels.
+   */
+  Grid<SimCellData> getGrid() const;
+
+  /*
+   * Returns an image of `tile` of `grid`, one pixel per cell.
+   */
+  static QImage renderTile(const Grid<SimCellData> &grid,
+                           TileActivity::Tile tile);
+
   /*
    * Sets the pheromone strength to v/100.
    */
@@ -93,6 +154,7 @@ public:
       return;
 
     m_phStrength = (float)v / 100;
+    updateStencil();
   }
 
   /*
@@ -103,6 +165,7 @@ public:
       return;
 
     m_phSpread = v;
+    updateStencil();
   }
 
   /*
@@ -112,9 +175,52 @@ public:
     if (v < 0 || v > 100)
       return;
 
+    // Lazily evaporated levels assume the same rate since their last update
+    materializePheromones();
     m_phDecay = (float)v / 100;
   }
 
+  /*
+   * Enables or disables lazy evaporation. When enabled, each cell remembers
+   * the step its pheromones were last updated at and their evaporation is
+   * only computed when they are next read or written, so steps only cost
+   * the cells the ants touch. Levels are then lowered by the rate times the
+   * elapsed steps at once, which may round differently from one step at a
+   * time. Tiles the ants leave alone are brought up to date a few per step,
+   * so their trails fade on screen with some delay.
+   */
+  void setLazyEvaporation(bool lazy);
+
+  /*
+   * Sets the way pheromones are deposited to `deposition`, one of the
+   * Deposition values.
+   */
+  void setDeposition(int deposition) {
+    if (deposition == SEQUENTIAL || deposition == BATCHED)
+      m_deposition = static_cast<Deposition>(deposition);
+  }
+
+  /*
+   * Enables or disables fused steps. When enabled, each step ends with a
+   * single sweep of the active tiles that refreshes the nest pheromone and
+   * evaporates the pheromones for the next step, then draws the tile while
+   * it is still in cache. Ants read the same levels either way, but the
+   * levels shown are already evaporated for the next step.
+   */
+  void setFusedStep(bool fused) { m_fusedStep = fused; }
+
+  /*
+   * Stores pheromones as 16-bit fixed-point levels if `quantized` is true,
+   * or as floats otherwise. Fixed-point levels take half the memory and are
+   * evaporated with saturating integer kernels. Every update rounds them to
+   * the nearest multiple of 1/65535, so each deposit or evaporation moves
+   * them at most 0.5/65535 away from the float levels.
+   */
+  void setQuantized(bool quantized) {
+    m_grid.setPrecision(quantized ? Grid<SimCellData>::FIXED16
+                                  : Grid<SimCellData>::FLOAT);
+  }
+
   /*
    * Sets the number of ants to simulate.
    */
@@ -126,7 +232,8 @@ public:
   void setMaxAntSteps(int n);
 
   /*
-   * Resets all parameters to their default value.
+   * Resets all parameters to their default value. Must be called from the
+   * simulator's thread, as it changes the grid and the deposit stencil.
    */
   void resetParams();
 
@@ -159,9 +266,17 @@ public slots:
 
 signals:
   /*
-   * Emitted when the simulation step is completed.
+   * Emitted when the whole grid changes, with the grid of generation
+   * `generation`, see `getGeneration`.
    */
-  void gridReady(Grid<SimCellData> grid);
+  void gridReady(Grid<SimCellData> grid, int generation);
+
+  /*
+   * Emitted when the simulation step is completed, with images of the tiles
+   * that changed since the last emission, of the grid of generation
+   * `generation`, see `getGeneration`.
+   */
+  void tilesReady(std::vector<AntSimulator::TileImage> tiles, int generation);
 
   /*
    * Emitted when initialization is completed.
@@ -187,6 +302,188 @@ private:
   int m_seed;                // Seed for the rng
   std::default_random_engine m_rng; // Random number generator
   std::vector<Ant> m_ants;          // Vector to keep track of the ants
+  TileActivity m_activity;          // Tiles with pheromones or population
+  std::vector<uint32_t> m_phTicks;  // Step each cell's pheromones date from
+  uint32_t m_tick = 0;              // Steps performed, for lazy evaporation
+  bool m_lazyEvaporation = false;   // Whether evaporation is deferred
+  int m_refreshedTile = -1;         // Tile last brought up to date in turn
+  int m_generation = 0;             // Grids set up so far
+  DepositStencil m_stencil;         // Deposit weights for the strength
+
+  /*
+   * Pheromone deposit of an ant, centered on the cell it left.
+   */
+  struct Deposit {
+    int x;        // x coordinate of the source
+    int y;        // y coordinate of the source
+    int traveled; // Distance traveled by the ant
+    bool food;    // Whether food pheromone is deposited instead of home
+  };
+
+  /*
+   * Pheromone added to one cell by a deposit.
+   */
+  struct CellDeposit {
+    int index;    // Index of the cell
+    bool food;    // Whether the pheromone is food pheromone
+    float amount; // Amount of pheromone added
+  };
+
+  Deposition m_deposition = SEQUENTIAL; // Way pheromones are deposited
+  std::vector<Deposit> m_deposits;      // Deposits of the step, if batched
+  bool m_fusedStep = false;             // Whether steps end with a sweep
+  bool m_stepPrepared = false;          // Whether the next step was swept for
+
+  // Width of the rock halo around the grid, which covers the cells ahead of
+  // the ants, so that sensing needs no bounds checks
+  static const int HALO = 1;
+
+  /*
+   * Deposits the nest pheromone on the cells around the nest that lie within
+   * `bounds`.
+   */
+  void refreshNest(TileActivity::Tile bounds);
+
+  /*
+   * Evaporates the pheromones of the tile with index `tile`, or brings them
+   * up to date if pheromones evaporate lazily, and deactivates the tile if
+   * nothing is left on it.
+   */
+  void updateTile(int tile);
+
+  /*
+   * Prepares the pheromones of the active tiles for the next step in a
+   * single sweep, returning images of the tiles that changed. If pheromones
+   * evaporate lazily, only the tiles from `nextLazyTiles` are swept.
+   */
+  std::vector<TileImage> sweepActiveTiles();
+
+  /*
+   * Number of untouched active tiles brought up to date at each step when
+   * pheromones evaporate lazily.
+   */
+  static constexpr int LAZY_REFRESH_TILES = 8;
+
+  /*
+   * Returns the tiles to bring up to date at the end of a step when
+   * pheromones evaporate lazily: the dirty tiles, and the next
+   * LAZY_REFRESH_TILES active tiles in turn, in increasing order.
+   */
+  std::vector<int> nextLazyTiles();
+
+  /*
+   * Calls `deposit(j, distance)` for the index `j` of each cell of the grid
+   * within `m_phSpread` steps of the cell at column `x` and row `y`, at
+   * `distance` steps from it, row by row. Cells past the edges are skipped,
+   * so the halo never holds pheromones.
+   */
+  template <typename F> void visitDeposit(int x, int y, F &&deposit) const {
+    int i = m_grid.indexOf(x, y);
+    int dyEnd = std::min(m_phSpread, m_grid.getRows() - 1 - y);
+    for (int dy = std::max(-m_phSpread, -y); dy <= dyEnd; dy++) {
+      int span = m_phSpread - std::abs(dy);
+      int dxEnd = std::min(span, m_grid.getCols() - 1 - x);
+      for (int dx = std::max(-span, -x); dx <= dxEnd; dx++)
+        deposit(i + m_grid.offsetOf(dx, dy), std::abs(dx) + std::abs(dy));
+    }
+  }
+
+  /*
+   * Adds the pheromones of the deposits of the step to the grid in a single
+   * pass, clamping each level once.
+   */
+  void applyDeposits();
+
+  /*
+   * Rebuilds the deposit weights for the current pheromone strength and
+   * spread.
+   */
+  void updateStencil() {
+    m_stencil = DepositStencil(m_phStrength, m_phSpread,
+                               getMaxAntStepsRange().second);
+  }
+
+  /*
+   * Brings the pheromone levels of the i-th cell up to date, if pheromones
+   * evaporate lazily.
+   */
+  void materializePheromones(int i) {
+    if (!m_lazyEvaporation || m_phTicks[i] == m_tick)
+      return;
+
+    int32_t elapsed = m_tick - m_phTicks[i];
+    m_phTicks[i] = m_tick;
+    if (isQuantized()) {
+      int decay = std::min<int64_t>(
+          int64_t(elapsed) * Grid<SimCellData>::toFixed(m_phDecay),
+          Grid<SimCellData>::FIXED_ONE);
+      uint16_t &home = m_grid.homeLevelAt(i);
+      uint16_t &food = m_grid.foodLevelAt(i);
+      home = std::max(home - decay, 0);
+      food = std::max(food - decay, 0);
+      return;
+    }
+
+    float decay = m_phDecay * elapsed;
+    float &home = m_grid.homePheromoneAt(i);
+    float &food = m_grid.foodPheromoneAt(i);
+    home = std::max(home - decay, 0.0f);
+    food = std::max(food - decay, 0.0f);
+  }
+
+  /*
+   * Adds `amount` of food pheromone to the i-th cell if `food` is true, or
+   * of home pheromone otherwise, up to a level of 1.
+   */
+  void addPheromone(int i, bool food, float amount) {
+    if (isQuantized()) {
+      uint16_t &level = food ? m_grid.foodLevelAt(i) : m_grid.homeLevelAt(i);
+      level = std::min(level + Grid<SimCellData>::toFixed(amount),
+                       Grid<SimCellData>::FIXED_ONE);
+      return;
+    }
+
+    float &level = food ? m_grid.foodPheromoneAt(i) : m_grid.homePheromoneAt(i);
+    level = std::min(level + amount, 1.0f);
+  }
+
+  /*
+   * Brings the pheromone levels of every cell up to date, if pheromones
+   * evaporate lazily.
+   */
+  void materializePheromones();
+
+  /*
+   * Marks the cell at column `x` and row `y` as changed, making its tile
+   * active and dirty.
+   */
+  void touch(int x, int y) { m_activity.markActive(x, y); }
+
+  /*
+   * Marks the cells within `radius` columns and rows of the cell at column
+   * `x` and row `y` as changed.
+   */
+  void touch(int x, int y, int radius) {
+    m_activity.markActive(
+        {x - radius, y - radius, x + radius + 1, y + radius + 1});
+  }
+
+  /*
+   * Evaporates the pheromones of the active tiles, or brings them up to date
+   * if pheromones evaporate lazily, and marks the tiles dirty. Tiles left
+   * without pheromones nor population become inactive.
+   */
+  void updateActiveTiles();
+
+  /*
+   * Returns true if `tile` holds ants, food or the nest.
+   */
+  bool hasPopulation(TileActivity::Tile tile) const;
+
+  /*
+   * Returns images of the dirty tiles, marking them clean.
+   */
+  std::vector<TileImage> renderDirtyTiles();
 };
 
 #endif // ANT_SIM_H
@@ -0,0 +1,195 @@
+#include "bit_grid.h"
+#include "sim_cell_data.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+/*
+ * Per-bit majority of three words, i.e. the carry of a full adder.
+ */
+inline uint64_t majority(uint64_t a, uint64_t b, uint64_t c) {
+  return (a & b) | (c & (a ^ b));
+}
+
+/*
+ * Returns a mask of the cells whose 4-bit count, sliced across `bits`
+ * (least significant plane first), is at least `threshold`.
+ */
+inline uint64_t atLeast(const uint64_t bits[4], int threshold) {
+  if (threshold <= 0)
+    return ~uint64_t(0);
+  if (threshold > 8)
+    return 0;
+
+  // Bit-sliced comparison against a constant, from the most significant bit
+  uint64_t greater = 0;
+  uint64_t equal = ~uint64_t(0);
+  for (int b = 3; b >= 0; b--) {
+    if (threshold & (1 << b)) {
+      equal &= bits[b];
+    } else {
+      greater |= equal & bits[b];
+      equal &= ~bits[b];
+    }
+  }
+
+  return greater | equal;
+}
+
+/*
+ * Set of neighbour counts in [0, 8], with the threshold t of sets of the form
+ * "at least t", which only need a single comparison, or -1 for other sets.
+ */
+struct CountSet {
+  uint16_t counts;
+  int threshold;
+
+  explicit CountSet(uint16_t mask) : counts(mask & 0x1FF), threshold(-1) {
+    for (int t = 0; t <= 9 && threshold < 0; t++) {
+      if (counts == (0x1FF & (0x1FF << t)))
+        threshold = t;
+    }
+  }
+};
+
+/*
+ * Returns a mask of the cells whose 4-bit count, sliced across `bits`, is in
+ * `set`.
+ */
+inline uint64_t countIn(const uint64_t bits[4], const CountSet &set) {
+  if (set.threshold >= 0)
+    return atLeast(bits, set.threshold);
+
+  uint64_t mask = 0;
+  for (int count = 0; count <= 8; count++) {
+    if (!(set.counts & (1 << count)))
+      continue;
+
+    uint64_t equal = ~uint64_t(0);
+    for (int b = 0; b < 4; b++)
+      equal &= count & (1 << b) ? bits[b] : ~bits[b];
+    mask |= equal;
+  }
+
+  return mask;
+}
+
+} // namespace
+
+BitGrid::BitGrid(int rows, int cols) { resize(rows, cols); }
+
+void BitGrid::resize(int rows, int cols) {
+  if (rows < 0 || cols < 0)
+    throw std::invalid_argument(
+        "The number of rows and columns cannot be negative.");
+
+  m_rows = rows;
+  m_cols = cols;
+  m_words = (cols + 63) / 64;
+  m_lastMask = cols % 64 == 0 ? ~uint64_t(0) : (uint64_t(1) << cols % 64) - 1;
+  m_bits.assign(static_cast<size_t>(rows) * m_words, 0);
+  m_none.assign(m_words, 0);
+}
+
+void BitGrid::load(std::span<const uint8_t> types) {
+  if (types.size() != static_cast<size_t>(m_rows) * m_cols)
+    throw std::invalid_argument("Mismatched grid dimensions.");
+
+  for (int y = 0; y < m_rows; y++) {
+    const uint8_t *src = types.data() + static_cast<size_t>(y) * m_cols;
+    uint64_t *dst = row(y);
+
+    for (int w = 0; w < m_words; w++) {
+      uint64_t word = 0;
+      int count = std::min(64, m_cols - w * 64);
+      for (int b = 0; b < count; b++) {
+        if (src[w * 64 + b] == SimCellData::ROCK)
+          word |= uint64_t(1) << b;
+      }
+      dst[w] = word;
+    }
+  }
+}
+
+void BitGrid::store(std::span<uint8_t> types) const {
+  if (types.size() != static_cast<size_t>(m_rows) * m_cols)
+    throw std::invalid_argument("Mismatched grid dimensions.");
+
+  for (int y = 0; y < m_rows; y++) {
+    const uint64_t *src = row(y);
+    uint8_t *dst = types.data() + static_cast<size_t>(y) * m_cols;
+
+    for (int x = 0; x < m_cols; x++) {
+      dst[x] = (src[x / 64] >> (x % 64)) & 1 ? SimCellData::ROCK
+                                            : SimCellData::FLOOR;
+    }
+  }
+}
+
+bool BitGrid::stepMoore(const BitGrid &src, uint16_t birth, uint16_t survival,
+                        int rowBegin, int rowEnd, int wordBegin,
+                        int wordEnd) {
+  CountSet births(birth);
+  CountSet survivals(survival);
+  uint64_t changed = 0;
+
+  for (int y = rowBegin; y < rowEnd; y++) {
+    uint64_t *dst = row(y);
+    bool edgeRow = y == 0 || y == m_rows - 1;
+
+    // Rows outside the grid contribute no rocks
+    const uint64_t *above = y > 0 ? src.row(y - 1) : m_none.data();
+    const uint64_t *middle = src.row(y);
+    const uint64_t *below = y < m_rows - 1 ? src.row(y + 1) : m_none.data();
+
+    for (int w = wordBegin; w < wordEnd; w++) {
+      // Align the west and east neighbours of each cell with the cell itself,
+      // carrying bits across word boundaries
+      auto west = [&](const uint64_t *r) {
+        return (r[w] << 1) | (w > 0 ? r[w - 1] >> 63 : 0);
+      };
+      auto east = [&](const uint64_t *r) {
+        return (r[w] >> 1) | (w < m_words - 1 ? r[w + 1] << 63 : 0);
+      };
+
+      uint64_t aw = west(above), a = above[w], ae = east(above);
+      uint64_t bw = west(below), b = below[w], be = east(below);
+      uint64_t mw = west(middle), me = east(middle);
+
+      // Sum the eight neighbours with bit-sliced adders
+      uint64_t aSum = aw ^ a ^ ae, aCarry = majority(aw, a, ae);
+      uint64_t bSum = bw ^ b ^ be, bCarry = majority(bw, b, be);
+      uint64_t mSum = mw ^ me, mCarry = mw & me;
+
+      uint64_t count[4];
+      count[0] = aSum ^ bSum ^ mSum;
+      uint64_t ones = majority(aSum, bSum, mSum);
+
+      uint64_t twos = aCarry ^ bCarry ^ mCarry;
+      uint64_t fours = majority(aCarry, bCarry, mCarry);
+      count[1] = twos ^ ones;
+      uint64_t carry = twos & ones;
+      count[2] = fours ^ carry;
+      count[3] = fours & carry;
+
+      // Floor cells follow the birth set and rocks the survival set
+      uint64_t next = countIn(count, births);
+      if (survival != birth)
+        next = (next & ~middle[w]) | (countIn(count, survivals) & middle[w]);
+
+      // Border cells are always rock
+      if (edgeRow)
+        next = ~uint64_t(0);
+      if (w == 0)
+        next |= 1;
+      if (w == m_words - 1)
+        next = (next | uint64_t(1) << ((m_cols - 1) % 64)) & m_lastMask;
+
+      changed |= next ^ middle[w];
+      dst[w] = next;
+    }
+  }
+
+  return changed != 0;
+}
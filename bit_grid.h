@@ -0,0 +1,82 @@
+#ifndef BIT_GRID_H
+#define BIT_GRID_H
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/*
+ * A grid of rock/floor cells packed one bit per cell, 64 cells per word.
+ * Each row starts on a word boundary and unused bits past the last column
+ * are kept clear.
+ */
+class BitGrid {
+
+public:
+  /*
+   *  Creates a grid of floor cells with the specified number of rows and
+   *  columns.
+   */
+  BitGrid(int rows = 0, int cols = 0);
+
+  /*
+   *  Resizes the grid to be `rows` tall and `cols` wide.
+   *  All contents are discarded.
+   */
+  void resize(int rows, int cols);
+
+  /*
+   *  Packs the row-major cell types in `types` into the grid, marking rock
+   *  cells with a set bit.
+   */
+  void load(std::span<const uint8_t> types);
+
+  /*
+   *  Unpacks the grid into the row-major cell types in `types`.
+   */
+  void store(std::span<uint8_t> types) const;
+
+  /*
+   *  Computes rows [rowBegin, rowEnd) and words [wordBegin, wordEnd) of one
+   *  step of the cave rule over `src`, counting rocks in the radius 1 Moore
+   *  neighbourhood of each cell. Bit k of `birth` is set if a floor cell
+   *  with k rock neighbours turns into rock, and bit k of `survival` if a
+   *  rock cell with k rock neighbours stays rock. Border cells are always
+   *  rock. Cells outside the grid are not counted. `src` must have the same
+   *  dimensions as this grid. Returns true if any of the computed cells
+   *  differs from `src`.
+   */
+  bool stepMoore(const BitGrid &src, uint16_t birth, uint16_t survival,
+                 int rowBegin, int rowEnd, int wordBegin, int wordEnd);
+
+  /*
+   *  Returns the number of words per row.
+   */
+  int getWords() const { return m_words; }
+
+  /*
+   *  Returns the number of rows.
+   */
+  int getRows() const { return m_rows; }
+
+  /*
+   *  Returns the number of columns.
+   */
+  int getCols() const { return m_cols; }
+
+private:
+  int m_rows;                   // Number of rows
+  int m_cols;                   // Number of columns
+  int m_words;                  // Number of words per row
+  uint64_t m_lastMask;          // Valid bits of the last word of each row
+  std::vector<uint64_t> m_bits; // Packed cells
+  std::vector<uint64_t> m_none; // Empty row standing for rows off the grid
+
+  /*
+   *  Returns a pointer to the first word of row `y`.
+   */
+  uint64_t *row(int y) { return m_bits.data() + y * m_words; }
+  const uint64_t *row(int y) const { return m_bits.data() + y * m_words; }
+};
+
+#endif // BIT_GRID_H
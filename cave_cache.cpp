@@ -0,0 +1,249 @@
+#include "cave_cache.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace {
+
+/*
+ * Identifies cave files and their layout version.
+ */
+const char MAGIC[4] = {'C', 'A', 'V', 'E'};
+const uint32_t VERSION = 1;
+
+/*
+ * Returns the 64-bit FNV-1a hash of `text`.
+ */
+uint64_t hash(const std::string &text) {
+  uint64_t hash = 0xcbf29ce484222325;
+  for (char c : text) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 0x100000001b3;
+  }
+
+  return hash;
+}
+
+/*
+ * Writes the native representation of `value` to `out`.
+ */
+template <typename T> void put(std::ostream &out, T value) {
+  out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+/*
+ * Reads the native representation of a T from `in` into `value`. Returns
+ * false on failure.
+ */
+template <typename T> bool get(std::istream &in, T &value) {
+  return static_cast<bool>(
+      in.read(reinterpret_cast<char *>(&value), sizeof(value)));
+}
+
+} // namespace
+
+CaveCache::CaveCache(size_t memoryBudget) : m_budget(memoryBudget) {}
+
+std::optional<CaveCache::Cave> CaveCache::find(const std::string &key,
+                                               int rows, int cols) {
+  auto it = m_index.find(key);
+  if (it != m_index.end() && it->second->rows == rows &&
+      it->second->cols == cols) {
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return unpack(*it->second);
+  }
+
+  if (m_directory.empty())
+    return std::nullopt;
+
+  std::optional<Entry> entry = read(key, rows, cols);
+  if (!entry)
+    return std::nullopt;
+
+  Cave cave = unpack(*entry);
+  remember(std::move(*entry));
+  return cave;
+}
+
+bool CaveCache::contains(const std::string &key) const {
+  if (m_index.contains(key))
+    return true;
+
+  std::error_code error;
+  return !m_directory.empty() && std::filesystem::exists(pathOf(key), error);
+}
+
+void CaveCache::insert(const std::string &key, const Grid<SimCellData> &grid,
+                       int steps, const std::vector<int> &regionSizes) {
+  if (m_budget == 0 && m_directory.empty())
+    return;
+
+  std::optional<Entry> entry = pack(key, grid);
+  if (!entry)
+    return;
+
+  entry->steps = steps;
+  entry->regionSizes = regionSizes;
+
+  if (!m_directory.empty())
+    write(*entry);
+
+  remember(std::move(*entry));
+}
+
+void CaveCache::setMemoryBudget(size_t bytes) {
+  m_budget = bytes;
+  evict();
+}
+
+void CaveCache::clear() {
+  m_entries.clear();
+  m_index.clear();
+  m_usage = 0;
+}
+
+size_t CaveCache::Entry::size() const {
+  return sizeof(Entry) + key.capacity() + bits.capacity() +
+         regionSizes.capacity() * sizeof(int);
+}
+
+void CaveCache::remember(Entry entry) {
+  auto it = m_index.find(entry.key);
+  if (it != m_index.end()) {
+    m_usage -= it->second->size();
+    m_entries.erase(it->second);
+    m_index.erase(it);
+  }
+
+  m_usage += entry.size();
+  m_entries.push_front(std::move(entry));
+  m_index[m_entries.front().key] = m_entries.begin();
+
+  evict();
+}
+
+void CaveCache::evict() {
+  while (m_usage > m_budget && !m_entries.empty()) {
+    m_usage -= m_entries.back().size();
+    m_index.erase(m_entries.back().key);
+    m_entries.pop_back();
+  }
+}
+
+std::string CaveCache::pathOf(const std::string &key) const {
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.cave",
+           static_cast<unsigned long long>(hash(key)));
+
+  return (std::filesystem::path(m_directory) / name).string();
+}
+
+void CaveCache::write(const Entry &entry) const {
+  std::error_code error;
+  std::filesystem::create_directories(m_directory, error);
+  if (error)
+    return;
+
+  // Write to a temporary file first so that readers never see partial caves
+  std::string path = pathOf(entry.key);
+  std::string tmpPath = path + ".tmp";
+  {
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    out.write(MAGIC, sizeof(MAGIC));
+    put<uint32_t>(out, VERSION);
+    put<uint32_t>(out, entry.key.size());
+    out.write(entry.key.data(), entry.key.size());
+    put<int32_t>(out, entry.rows);
+    put<int32_t>(out, entry.cols);
+    put<int32_t>(out, entry.steps);
+    put<uint32_t>(out, entry.regionSizes.size());
+    for (int size : entry.regionSizes)
+      put<int32_t>(out, size);
+    out.write(reinterpret_cast<const char *>(entry.bits.data()),
+              entry.bits.size());
+
+    if (!out)
+      return;
+  }
+
+  std::filesystem::rename(tmpPath, path, error);
+}
+
+std::optional<CaveCache::Entry>
+CaveCache::read(const std::string &key, int rows, int cols) const {
+  std::ifstream in(pathOf(key), std::ios::binary);
+  if (!in)
+    return std::nullopt;
+
+  char magic[sizeof(MAGIC)];
+  uint32_t version, keySize;
+  if (!in.read(magic, sizeof(magic)) ||
+      std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || !get(in, version) ||
+      version != VERSION || !get(in, keySize) || keySize != key.size())
+    return std::nullopt;
+
+  // Different keys may hash to the same file
+  Entry entry;
+  entry.key.resize(keySize);
+  if (!in.read(entry.key.data(), keySize) || entry.key != key)
+    return std::nullopt;
+
+  // Corrupt dimensions must not drive the allocations below
+  int32_t fileRows, fileCols, steps;
+  uint32_t regions;
+  if (!get(in, fileRows) || !get(in, fileCols) || !get(in, steps) ||
+      !get(in, regions) || fileRows != rows || fileCols != cols ||
+      regions > static_cast<uint64_t>(rows) * cols)
+    return std::nullopt;
+
+  entry.rows = rows;
+  entry.cols = cols;
+  entry.steps = steps;
+  entry.regionSizes.resize(regions);
+  for (int &size : entry.regionSizes) {
+    if (!get(in, size))
+      return std::nullopt;
+  }
+
+  entry.bits.resize((static_cast<size_t>(rows) * cols + 7) / 8);
+  if (!in.read(reinterpret_cast<char *>(entry.bits.data()),
+               entry.bits.size()))
+    return std::nullopt;
+
+  return entry;
+}
+
+std::optional<CaveCache::Entry>
+CaveCache::pack(const std::string &key, const Grid<SimCellData> &grid) {
+  std::span<const uint8_t> types = grid.getTypePlane();
+
+  Entry entry;
+  entry.key = key;
+  entry.rows = grid.getRows();
+  entry.cols = grid.getCols();
+  entry.steps = 0;
+  entry.bits.assign((types.size() + 7) / 8, 0);
+
+  for (size_t i = 0; i < types.size(); i++) {
+    if (types[i] == SimCellData::ROCK)
+      entry.bits[i / 8] |= 1 << (i % 8);
+    else if (types[i] != SimCellData::FLOOR)
+      return std::nullopt;
+  }
+
+  return entry;
+}
+
+CaveCache::Cave CaveCache::unpack(const Entry &entry) {
+  Cave cave = {Grid<SimCellData>(entry.rows, entry.cols), entry.steps,
+               entry.regionSizes};
+  std::span<uint8_t> types = cave.grid.getTypePlane();
+
+  for (size_t i = 0; i < types.size(); i++) {
+    types[i] = (entry.bits[i / 8] >> (i % 8)) & 1 ? SimCellData::ROCK
+                                                  : SimCellData::FLOOR;
+  }
+
+  return cave;
+}
@@ -0,0 +1,162 @@
+#ifndef CAVE_CACHE_H
+#define CAVE_CACHE_H
+
+#include "sim_grid.h"
+#include <cstdint>
+#include <list>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Cache of generated caves, keyed by a string describing every parameter
+ * which affects the cave. Caves are kept in memory packed one bit per cell,
+ * evicting the least recently used ones once over the memory budget, and
+ * can also be written to a directory to survive across sessions.
+ */
+class CaveCache {
+
+public:
+  /*
+   * A generated cave, with the number of steps which changed it and the
+   * sizes of its floor regions, if they were computed.
+   */
+  struct Cave {
+    Grid<SimCellData> grid;
+    int steps;
+    std::vector<int> regionSizes;
+  };
+
+  /*
+   *  Creates an empty cache with a memory budget of `memoryBudget` bytes and
+   *  no directory.
+   */
+  explicit CaveCache(size_t memoryBudget = 0);
+
+  /*
+   *  Returns the cave with `rows` rows and `cols` columns stored under
+   *  `key`, looking in memory first and then in the directory, or nothing
+   *  if there is none. Caves found on disk are brought into memory.
+   */
+  std::optional<Cave> find(const std::string &key, int rows, int cols);
+
+  /*
+   *  Returns true if a cave is stored under `key`, in memory or in the
+   *  directory, without loading it.
+   */
+  bool contains(const std::string &key) const;
+
+  /*
+   *  Stores the cave in `grid` under `key`, in memory and in the directory
+   *  if set, along with the number of steps which changed it and the sizes
+   *  of its floor regions. Caves made of other cells than rock and floor
+   *  are not cached.
+   */
+  void insert(const std::string &key, const Grid<SimCellData> &grid,
+              int steps, const std::vector<int> &regionSizes);
+
+  /*
+   *  Returns the memory budget, in bytes.
+   */
+  size_t getMemoryBudget() const { return m_budget; }
+
+  /*
+   *  Returns the memory taken by the cached caves, in bytes.
+   */
+  size_t getMemoryUsage() const { return m_usage; }
+
+  /*
+   *  Sets the memory budget to `bytes`, evicting caves to fit it. A budget
+   *  of 0 keeps no cave in memory.
+   */
+  void setMemoryBudget(size_t bytes);
+
+  /*
+   *  Returns the directory caves are written to, empty if none.
+   */
+  const std::string &getDirectory() const { return m_directory; }
+
+  /*
+   *  Sets the directory caves are written to and read from to `directory`,
+   *  which is created when needed. An empty directory disables the disk
+   *  cache.
+   */
+  void setDirectory(const std::string &directory) { m_directory = directory; }
+
+  /*
+   *  Removes every cave from memory. Files are left untouched.
+   */
+  void clear();
+
+private:
+  /*
+   * A cave packed for storage, eight cells per byte in row-major order with
+   * rocks as set bits.
+   */
+  struct Entry {
+    std::string key;
+    int rows;
+    int cols;
+    int steps;
+    std::vector<int> regionSizes;
+    std::vector<uint8_t> bits;
+
+    /*
+     *  Returns the memory taken by the entry, in bytes.
+     */
+    size_t size() const;
+  };
+
+  using Position = std::list<Entry>::iterator;
+
+  std::list<Entry> m_entries;                        // Most recent first
+  std::unordered_map<std::string, Position> m_index; // Entries by key
+
+  size_t m_budget;         // Memory budget, in bytes
+  size_t m_usage = 0;      // Memory taken by the entries, in bytes
+  std::string m_directory; // Directory of the disk cache, empty if none
+
+  /*
+   *  Adds `entry` to the memory cache as the most recently used one and
+   *  evicts caves to fit the budget.
+   */
+  void remember(Entry entry);
+
+  /*
+   *  Evicts the least recently used caves until the cache fits the budget.
+   */
+  void evict();
+
+  /*
+   *  Returns the path of the file storing the cave with key `key`.
+   */
+  std::string pathOf(const std::string &key) const;
+
+  /*
+   *  Writes `entry` to its file in the directory. Failures are ignored, as
+   *  the cave can always be generated again.
+   */
+  void write(const Entry &entry) const;
+
+  /*
+   *  Reads the entry with key `key` and a cave with `rows` rows and `cols`
+   *  columns from its file in the directory, returning nothing if it is
+   *  missing or invalid.
+   */
+  std::optional<Entry> read(const std::string &key, int rows, int cols) const;
+
+  /*
+   *  Packs the cave in `grid` into an entry with key `key`, returning
+   *  nothing if it has other cells than rock and floor.
+   */
+  static std::optional<Entry> pack(const std::string &key,
+                                   const Grid<SimCellData> &grid);
+
+  /*
+   *  Unpacks `entry` into a cave.
+   */
+  static Cave unpack(const Entry &entry);
+};
+
+#endif // CAVE_CACHE_H
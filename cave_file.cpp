@@ -0,0 +1,137 @@
+#include "cave_file.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+/*
+ * Identifies cave files and their layout version.
+ */
+const char MAGIC[4] = {'C', 'A', 'V', 'T'};
+const uint32_t VERSION = 1;
+
+/*
+ * Header at the start of a cave file, in native representation. The tiles
+ * follow from the next page.
+ */
+struct Header {
+  char magic[sizeof(MAGIC)];
+  uint32_t version;
+  int32_t rows;
+  int32_t cols;
+  int32_t steps;
+  int32_t tileShift;
+};
+
+} // namespace
+
+std::optional<CaveFile> CaveFile::create(const std::string &path, int rows,
+                                         int cols) {
+  if (rows < 0 || cols < 0)
+    throw std::invalid_argument(
+        "The number of rows and columns cannot be negative.");
+
+  auto file = std::make_unique<QFile>(QString::fromStdString(path));
+  if (!file->open(QIODevice::ReadWrite | QIODevice::Truncate))
+    return std::nullopt;
+
+  Header header = {};
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.rows = rows;
+  header.cols = cols;
+  header.tileShift = TILE_SHIFT;
+
+  // Resizing fills the tiles with zeros, which are floor cells, without
+  // writing them on file systems supporting sparse files
+  qint64 size = fileSize(rows, cols);
+  if (file->write(reinterpret_cast<const char *>(&header), sizeof(header)) !=
+          sizeof(header) ||
+      !file->resize(size))
+    return std::nullopt;
+
+  uchar *data = file->map(0, size);
+  if (!data)
+    return std::nullopt;
+
+  return CaveFile(std::move(file), data, rows, cols, true);
+}
+
+std::optional<CaveFile> CaveFile::open(const std::string &path) {
+  auto file = std::make_unique<QFile>(QString::fromStdString(path));
+  if (!file->open(QIODevice::ReadOnly))
+    return std::nullopt;
+
+  Header header;
+  if (file->read(reinterpret_cast<char *>(&header), sizeof(header)) !=
+          sizeof(header) ||
+      std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      header.version != VERSION || header.tileShift != TILE_SHIFT ||
+      header.rows < 0 || header.cols < 0 ||
+      file->size() < fileSize(header.rows, header.cols))
+    return std::nullopt;
+
+  uchar *data = file->map(0, fileSize(header.rows, header.cols));
+  if (!data)
+    return std::nullopt;
+
+  return CaveFile(std::move(file), data, header.rows, header.cols, false);
+}
+
+int CaveFile::getSteps() const {
+  Header header;
+  std::memcpy(&header, m_data, sizeof(header));
+  return header.steps;
+}
+
+void CaveFile::setSteps(int steps) {
+  if (!m_writable)
+    throw std::invalid_argument("The cave file is read-only.");
+
+  int32_t value = steps;
+  std::memcpy(m_data + offsetof(Header, steps), &value, sizeof(value));
+}
+
+void CaveFile::read(Grid<SimCellData> &area, int x0, int y0) const {
+  checkArea(x0, y0, area.getRows(), area.getCols());
+
+  for (int y = 0; y < area.getRows(); y++) {
+    std::span<uint8_t> row = area.getTypeRow(y);
+    visitRuns(y0 + y, x0, area.getCols(), [&](size_t offset, int x, int count) {
+      std::transform(m_plane + offset, m_plane + offset + count,
+                     row.data() + (x - x0), toType);
+    });
+  }
+}
+
+void CaveFile::write(const Grid<SimCellData> &area, int x0, int y0) {
+  if (!m_writable)
+    throw std::invalid_argument("The cave file is read-only.");
+  checkArea(x0, y0, area.getRows(), area.getCols());
+
+  for (int y = 0; y < area.getRows(); y++) {
+    std::span<const uint8_t> row = area.getTypeRow(y);
+    visitRuns(y0 + y, x0, area.getCols(), [&](size_t offset, int x, int count) {
+      std::memcpy(m_plane + offset, row.data() + (x - x0), count);
+    });
+  }
+}
+
+CaveFile::CaveFile(std::unique_ptr<QFile> file, uchar *data, int rows,
+                   int cols, bool writable)
+    : m_file(std::move(file)), m_data(data), m_plane(data + PAGE_SIZE),
+      m_rows(rows), m_cols(cols),
+      m_tileCols((cols + TILE_SIDE - 1) >> TILE_SHIFT), m_writable(writable) {
+}
+
+void CaveFile::checkArea(int x0, int y0, int rows, int cols) const {
+  if (x0 < 0 || y0 < 0 || x0 > m_cols - cols || y0 > m_rows - rows)
+    throw std::invalid_argument("Area does not lie within the cave.");
+}
+
+qint64 CaveFile::fileSize(int rows, int cols) {
+  qint64 tileRows = (static_cast<qint64>(rows) + TILE_SIDE - 1) >> TILE_SHIFT;
+  qint64 tileCols = (static_cast<qint64>(cols) + TILE_SIDE - 1) >> TILE_SHIFT;
+  return PAGE_SIZE * (1 + tileRows * tileCols);
+}
@@ -0,0 +1,165 @@
+#ifndef CAVE_FILE_H
+#define CAVE_FILE_H
+
+#include "sim_grid.h"
+#include <QFile>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+
+/*
+ * A cave stored in a file and mapped into memory, so that caves larger than
+ * the memory can be opened at once and only the parts in use are read. The
+ * cell types are stored in square tiles of one byte per cell, each taking
+ * one page, so that nearby cells share pages. Files opened read-only can be
+ * shared by several processes.
+ */
+class CaveFile {
+
+public:
+  static const int TILE_SHIFT = 6;              // Log2 of the side of a tile
+  static const int TILE_SIDE = 1 << TILE_SHIFT; // Side of a tile, in cells
+  static const int PAGE_SIZE = 4096;            // Alignment of the tiles
+
+  static_assert(TILE_SIDE * TILE_SIDE == PAGE_SIZE,
+                "Tiles must take exactly one page.");
+
+  /*
+   *  Creates the file at `path` for a cave with `rows` rows and `cols`
+   *  columns, all floor, replacing any existing file, and maps it for
+   *  reading and writing. Returns nothing if the file cannot be created or
+   *  mapped.
+   */
+  static std::optional<CaveFile> create(const std::string &path, int rows,
+                                        int cols);
+
+  /*
+   *  Maps the cave file at `path` read-only. Returns nothing if it is
+   *  missing, invalid or cannot be mapped.
+   */
+  static std::optional<CaveFile> open(const std::string &path);
+
+  /*
+   *  Returns the number of rows.
+   */
+  int getRows() const { return m_rows; }
+
+  /*
+   *  Returns the number of columns.
+   */
+  int getCols() const { return m_cols; }
+
+  /*
+   *  Returns true if the cave can be modified, false if it was opened
+   *  read-only.
+   */
+  bool isWritable() const { return m_writable; }
+
+  /*
+   *  Returns the number of steps which changed the cave when it was
+   *  generated.
+   */
+  int getSteps() const;
+
+  /*
+   *  Sets the number of steps which changed the cave to `steps`.
+   */
+  void setSteps(int steps);
+
+  /*
+   *  Returns the type of the cell at column `x` and row `y`, see `toType`.
+   *  Bounds are only checked in debug builds.
+   */
+  SimCellData::Type typeAt(int x, int y) const {
+    assert(x >= 0 && x < m_cols && y >= 0 && y < m_rows);
+    return static_cast<SimCellData::Type>(toType(m_plane[offsetOf(x, y)]));
+  }
+
+  /*
+   *  Copies the types of the cells of the cave starting at column `x0` and
+   *  row `y0` into `area`, whose other contents are left untouched, see
+   *  `toType`. Only the tiles overlapping the area are read from the file.
+   */
+  void read(Grid<SimCellData> &area, int x0, int y0) const;
+
+  /*
+   *  Copies the types of the cells of `area` into the cave, starting at
+   *  column `x0` and row `y0`.
+   */
+  void write(const Grid<SimCellData> &area, int x0, int y0);
+
+  /*
+   *  Returns the whole cave as a grid. Throws if the cave is too large for a
+   *  grid, see Grid<SimCellData>::fits.
+   */
+  Grid<SimCellData> toGrid() const {
+    Grid<SimCellData> grid(m_rows, m_cols);
+    read(grid, 0, 0);
+    return grid;
+  }
+
+private:
+  std::unique_ptr<QFile> m_file; // Mapped file
+  uchar *m_data;                 // Mapping of the whole file
+  uchar *m_plane;                // Tiles of the cell types, in the mapping
+  int m_rows;                    // Number of rows
+  int m_cols;                    // Number of columns
+  int m_tileCols;                // Number of tiles in a row of tiles
+  bool m_writable;               // Whether the mapping can be written
+
+  /*
+   *  Wraps the mapping `data` of `file` for a cave with `rows` rows and
+   *  `cols` columns.
+   */
+  CaveFile(std::unique_ptr<QFile> file, uchar *data, int rows, int cols,
+           bool writable);
+
+  /*
+   *  Returns the type stored as `byte`. Caves only hold rock and floor, so
+   *  any other byte is read as floor.
+   */
+  static uint8_t toType(uint8_t byte) {
+    return byte == SimCellData::ROCK ? SimCellData::ROCK : SimCellData::FLOOR;
+  }
+
+  /*
+   *  Returns the offset of the cell at column `x` and row `y` in the plane.
+   *  Tiles are stored row by row, and so are the cells within a tile.
+   */
+  size_t offsetOf(int x, int y) const {
+    size_t tile = static_cast<size_t>(y >> TILE_SHIFT) * m_tileCols +
+                  (x >> TILE_SHIFT);
+    return tile * PAGE_SIZE + ((y & (TILE_SIDE - 1)) << TILE_SHIFT) +
+           (x & (TILE_SIDE - 1));
+  }
+
+  /*
+   *  Calls `copy(offset, x, count)` for each run of `count` cells of row `y`
+   *  starting at column `x` which are contiguous in the plane from `offset`,
+   *  covering the `cols` cells of the row from column `x0`.
+   */
+  template <typename F>
+  void visitRuns(int y, int x0, int cols, F &&copy) const {
+    for (int x = x0; x < x0 + cols;) {
+      int count = std::min(x0 + cols, (x | (TILE_SIDE - 1)) + 1) - x;
+      copy(offsetOf(x, y), x, count);
+      x += count;
+    }
+  }
+
+  /*
+   *  Throws if the area of `rows` rows and `cols` columns starting at
+   *  column `x0` and row `y0` does not lie within the cave.
+   */
+  void checkArea(int x0, int y0, int rows, int cols) const;
+
+  /*
+   *  Returns the size of the file of a cave with `rows` rows and `cols`
+   *  columns, in bytes.
+   */
+  static qint64 fileSize(int rows, int cols);
+};
+
+#endif // CAVE_FILE_H
@@ -1,88 +1,702 @@
 #include "cave_gen.h"
+#include "bit_grid.h"
+#include "cave_file.h"
+#include "parallel.h"
+#include "region_labeler.h"
+#include "rock_tables.h"
+#include "tile_frontier.h"
+#include "value_noise.h"
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <cstring>
+#include <filesystem>
 #include <iostream>
 #include <random>
+#include <utility>
+
+namespace {
+
+/*
+ * Number of cells in the neighbourhood of type MODE and radius RADIUS,
+ * excluding the central cell.
+ */
+template <CaveGenerator::Mode MODE, int RADIUS>
+constexpr size_t neighbourhoodSize() {
+  if (MODE == CaveGenerator::MOORE)
+    return (2 * RADIUS + 1) * (2 * RADIUS + 1) - 1;
+  else
+    return 2 * RADIUS * (RADIUS + 1);
+}
 
 /*
- * Returns the number of rocks adjacent to this cell
+ * Offsets (dx, dy) of the cells in the neighbourhood of type MODE and radius
+ * RADIUS, excluding the central cell.
  */
-int countNearbyRocks(std::vector<Cell<SimCellData>> neighbours) {
-  int count = 0;
+template <CaveGenerator::Mode MODE, int RADIUS>
+constexpr auto neighbourOffsets() {
+  std::array<std::pair<int, int>, neighbourhoodSize<MODE, RADIUS>()> offsets;
+  size_t k = 0;
 
-  for (size_t i = 0; i < neighbours.size(); i++) {
-    if (neighbours[i].getData().getType() == SimCellData::Type::ROCK)
-      count++;
+  for (int dy = -RADIUS; dy <= RADIUS; dy++) {
+    for (int dx = -RADIUS; dx <= RADIUS; dx++) {
+      int dist = (dx < 0 ? -dx : dx) + (dy < 0 ? -dy : dy);
+      if ((dx != 0 || dy != 0) &&
+          (MODE == CaveGenerator::MOORE || dist <= RADIUS))
+        offsets[k++] = {dx, dy};
+    }
   }
 
-  return count;
+  return offsets;
 }
 
+template <CaveGenerator::Mode MODE, int RADIUS, size_t... I>
+inline void countRowUnrolled(const uint8_t *row, int cols, int begin,
+                             int end, uint8_t *counts,
+                             std::index_sequence<I...>) {
+  // Cells of a cave being generated are either rock or floor, so the rocks
+  // are counted by adding up the cells
+  static_assert(SimCellData::ROCK == 1 && SimCellData::FLOOR == 0);
+  constexpr auto offsets = neighbourOffsets<MODE, RADIUS>();
+
+  int count = end - begin;
+  std::fill(counts, counts + count, 0);
+
+  // Counts never exceed a byte, so eight of them are added at a time as the
+  // bytes of a word without carrying into each other
+  auto addNeighbour = [&](std::pair<int, int> offset) {
+    const uint8_t *neighbours =
+        row + offset.second * cols + offset.first + begin;
+
+    int x = 0;
+    for (; x + 8 <= count; x += 8) {
+      uint64_t sums, cells;
+      std::memcpy(&sums, counts + x, 8);
+      std::memcpy(&cells, neighbours + x, 8);
+      sums += cells;
+      std::memcpy(counts + x, &sums, 8);
+    }
+    for (; x < count; x++)
+      counts[x] += neighbours[x];
+  };
+
+  (addNeighbour(offsets[I]), ...);
+}
+
+/*
+ * Stores in `counts` the number of rocks in the neighbourhoods of type MODE
+ * and radius RADIUS around columns [begin, end) of `row`, in a row-major
+ * plane with `cols` columns. The neighbourhoods must lie within the plane.
+ * The neighbourhood is unrolled at compile time and each neighbour is added
+ * for the whole span of columns at once.
+ */
+template <CaveGenerator::Mode MODE, int RADIUS>
+inline void countRow(const uint8_t *row, int cols, int begin, int end,
+                     uint8_t *counts) {
+  constexpr size_t size = neighbourhoodSize<MODE, RADIUS>();
+  static_assert(size <= UINT8_MAX);
+
+  countRowUnrolled<MODE, RADIUS>(row, cols, begin, end, counts,
+                                 std::make_index_sequence<size>());
+}
+
+} // namespace
+
 CaveGenerator::CaveGenerator(int seed, int rockRatio, int threshold, int steps,
                              int radius)
     : m_seed(seed), m_rockRatio(rockRatio), m_threshold(threshold),
-      m_steps(steps), m_radius(radius) {
+      m_steps(steps), m_radius(radius), m_threads(defaultThreads()),
+      m_cache(defaultCacheBudget << 20) {
 
   if (rockRatio < 0 || rockRatio > 100 || threshold < 0 || threshold > 8 ||
       steps < 0 || radius < 0)
     std::invalid_argument("Arguments do not fall in the required ranges.");
 }
 
-void CaveGenerator::generateCave(int rows, int cols) {
+void CaveGenerator::generateCave(int rows, int cols, int ticket) {
+  // Requests superseded while queued are dropped
+  m_ticket = ticket;
+  if (isSuperseded())
+    return;
+
+  std::string key = cacheKey(rows, cols);
+  std::optional<CaveCache::Cave> cave = m_cache.find(key, rows, cols);
+  if (!cave)
+    cave = createCave(rows, cols, key);
+  if (!cave)
+    return;
+
+  emit stepsPerformed(cave->steps);
+  if (m_minRegionSize > 0 || m_keepLargestRegion)
+    emit regionsFound(cave->regionSizes);
+  emit gridReady(cave->grid);
+
+  schedulePrefetch(rows, cols);
+}
+
+std::optional<int> CaveGenerator::generateCaveFile(const std::string &path,
+                                                   int rows, int cols,
+                                                   int ticket) {
+  m_ticket = ticket;
+  if (isSuperseded())
+    return std::nullopt;
+
+  // Write to a temporary file first so that readers never see partial caves
+  std::string tmpPath = path + ".tmp";
+  std::optional<int> steps;
+  {
+    std::optional<CaveFile> file = CaveFile::create(tmpPath, rows, cols);
+    if (!file)
+      return std::nullopt;
+
+    if (m_backend == AUTOMATON && m_chunkSize > 0 && m_noise == HASHED &&
+        m_minRegionSize == 0 && !m_keepLargestRegion) {
+      steps = generateChunks(
+          rows, cols, [&](const Grid<SimCellData> &chunk, int x0, int y0) {
+            file->write(chunk, x0, y0);
+          });
+    } else {
+      std::string key = cacheKey(rows, cols);
+      std::optional<CaveCache::Cave> cave = m_cache.find(key, rows, cols);
+      if (!cave)
+        cave = createCave(rows, cols, key);
+      if (cave) {
+        file->write(cave->grid, 0, 0);
+        steps = cave->steps;
+      }
+    }
+
+    if (steps)
+      file->setSteps(*steps);
+  }
+
+  std::error_code error;
+  if (steps)
+    std::filesystem::rename(tmpPath, path, error);
+  if (!steps || error) {
+    std::filesystem::remove(tmpPath, error);
+    return std::nullopt;
+  }
+
+  return steps;
+}
+
+void CaveGenerator::saveCave(QString path, int rows, int cols, int ticket) {
+  std::optional<int> steps =
+      generateCaveFile(path.toStdString(), rows, cols, ticket);
+
+  if (steps)
+    emit caveFileSaved(path, *steps);
+  else if (!isSuperseded())
+    emit caveFileFailed(path);
+}
+
+void CaveGenerator::openCave(QString path, int ticket) {
+  m_ticket = ticket;
+  if (isSuperseded())
+    return;
+
+  // Caves too large for a grid can be mapped, but not simulated
+  std::optional<CaveFile> file = CaveFile::open(path.toStdString());
+  if (!file || !Grid<SimCellData>::fits(file->getRows(), file->getCols())) {
+    emit caveFileFailed(path);
+    return;
+  }
+
+  emit caveFileOpened(path, file->getSteps());
+  emit gridReady(file->toGrid());
+}
+
+std::optional<CaveCache::Cave>
+CaveGenerator::createCave(int rows, int cols, const std::string &key) {
   Grid<SimCellData> grid(rows, cols);
+  std::optional<int> steps;
+
+  if (m_backend == FRACTAL_NOISE) {
+    generateNoise(grid);
+    steps = 0;
+  } else if (m_chunkSize > 0 && m_noise == HASHED) {
+    steps = generateChunks(
+        rows, cols, [&](const Grid<SimCellData> &chunk, int x0, int y0) {
+          for (int y = 0; y < chunk.getRows(); y++)
+            std::ranges::copy(chunk.getTypeRow(y),
+                              grid.getTypeRow(y0 + y).begin() + x0);
+        });
+  } else {
+    initialize(grid);
+    m_previewTimer.start();
+    steps = simulate(grid);
+  }
+
+  if (!steps || isSuperseded())
+    return std::nullopt;
+
+  std::vector<int> regionSizes;
+  if (m_minRegionSize > 0 || m_keepLargestRegion)
+    regionSizes = fillRegions(grid);
+
+  m_cache.insert(key, grid, *steps, regionSizes);
+  return CaveCache::Cave{std::move(grid), *steps, std::move(regionSizes)};
+}
+
+int CaveGenerator::generateChunk(Grid<SimCellData> &chunk, int x0, int y0,
+                                 int worldRows, int worldCols) {
+  if (x0 < 0 || y0 < 0 || x0 > worldCols - chunk.getCols() ||
+      y0 > worldRows - chunk.getRows())
+    throw std::invalid_argument("Chunk does not lie within the cave.");
+
+  // Cells further than steps × radius from the edges of the area cannot be
+  // reached by the wrong values the edges take, as they are not the edges
+  // of the cave. Wider halos are clipped to the cave.
+  long long reach = static_cast<long long>(m_steps) * m_radius + 1;
+  int halo = std::min<long long>(reach, std::max(worldRows, worldCols));
+  int areaX0 = std::max(0, x0 - halo);
+  int areaY0 = std::max(0, y0 - halo);
+  int areaX1 = x0 + chunk.getCols() +
+               std::min(halo, worldCols - x0 - chunk.getCols());
+  int areaY1 = y0 + chunk.getRows() +
+               std::min(halo, worldRows - y0 - chunk.getRows());
+
+  Grid<SimCellData> area(areaY1 - areaY0, areaX1 - areaX0);
+  initializeHashed(area, areaX0, areaY0, worldRows, worldCols);
+
+  // Chunks are parts of a larger cave, so their steps are not reported
+  bool reportingSteps = std::exchange(m_reportingSteps, false);
+  int steps = simulate(area);
+  m_reportingSteps = reportingSteps;
+
+  for (int y = 0; y < chunk.getRows(); y++) {
+    std::span<const uint8_t> row = area.getTypeRow(y0 - areaY0 + y);
+    std::ranges::copy(row.subspan(x0 - areaX0, chunk.getCols()),
+                      chunk.getTypeRow(y).begin());
+  }
+
+  return steps;
+}
+
+void CaveGenerator::generateNoise(Grid<SimCellData> &grid) {
+  int rows = grid.getRows();
+  int cols = grid.getCols();
+  if (grid.getSize() == 0)
+    return;
+
+  ValueNoise noise(m_seed, m_noiseScale, m_noiseOctaves);
+  float threshold = m_rockRatio / 100.0f;
+
+  parallelRanges(0, rows, m_threads, [&](int begin, int end) {
+    std::vector<float> values(cols);
+    ValueNoise::RowCache cache;
+
+    for (int y = begin; y < end && !isSuperseded(); y++) {
+      noise.sampleRow(y, 0, values, cache);
+
+      std::span<uint8_t> row = grid.getTypeRow(y);
+      for (int x = 0; x < cols; x++)
+        row[x] = values[x] < threshold ? SimCellData::ROCK : SimCellData::FLOOR;
+
+      // Border cells are always rock
+      if (y == 0 || y == rows - 1) {
+        std::ranges::fill(row, SimCellData::ROCK);
+      } else {
+        row.front() = SimCellData::ROCK;
+        row.back() = SimCellData::ROCK;
+      }
+    }
+  });
+}
+
+void CaveGenerator::setVariant(const Variant &variant) {
+  m_seed = variant.seed;
+  m_rockRatio = variant.rockRatio;
+  m_threshold = variant.threshold;
+  m_steps = variant.steps;
+  m_radius = variant.radius;
+}
+
+void CaveGenerator::schedulePrefetch(int rows, int cols) {
+  m_prefetchQueue.clear();
+  if (m_prefetchCount <= 0 ||
+      (m_cache.getMemoryBudget() == 0 && m_cache.getDirectory().empty()))
+    return;
+
+  // Neighbours in each parameter, from the most to the least likely next
+  // request. The threshold has no effect under a custom rule, and noise
+  // caves are not evolved.
+  Variant current = getVariant();
+  auto vary = [&](int Variant::*parameter, int delta,
+                  std::pair<int, int> range) {
+    long long value = static_cast<long long>(current.*parameter) + delta;
+    if (value < range.first || value > range.second ||
+        static_cast<int>(m_prefetchQueue.size()) == m_prefetchCount)
+      return;
+
+    Variant variant = current;
+    variant.*parameter = value;
+    m_prefetchQueue.push_back(variant);
+  };
+
+  vary(&Variant::seed, 1, getSeedRange());
+  vary(&Variant::seed, -1, getSeedRange());
+  for (int delta : {1, -1}) {
+    vary(&Variant::rockRatio, delta, getRockRatioRange());
+    if (m_backend == FRACTAL_NOISE)
+      continue;
+
+    if (!m_rule)
+      vary(&Variant::threshold, delta, getThresholdRange());
+    vary(&Variant::steps, delta, getStepsRange());
+    vary(&Variant::radius, delta, getRadiusRange());
+  }
 
-  initialize(grid);
-  simulate(grid);
+  m_prefetchRows = rows;
+  m_prefetchCols = cols;
+  if (!m_prefetchQueue.empty())
+    QMetaObject::invokeMethod(
+        this, [this] { prefetchNext(); }, Qt::QueuedConnection);
+}
+
+void CaveGenerator::prefetchNext() {
+  // Newer requests supersede the speculation and schedule their own
+  if (m_prefetchQueue.empty() || isSuperseded()) {
+    m_prefetchQueue.clear();
+    return;
+  }
+
+  Variant requested = getVariant();
+  setVariant(m_prefetchQueue.front());
+  m_prefetchQueue.pop_front();
+
+  std::string key = cacheKey(m_prefetchRows, m_prefetchCols);
+  if (!m_cache.contains(key)) {
+    m_reportingSteps = false;
+    createCave(m_prefetchRows, m_prefetchCols, key);
+    m_reportingSteps = true;
+  }
+
+  setVariant(requested);
 
-  emit gridReady(grid);
+  if (!m_prefetchQueue.empty())
+    QMetaObject::invokeMethod(
+        this, [this] { prefetchNext(); }, Qt::QueuedConnection);
 }
 
 void CaveGenerator::initialize(Grid<SimCellData> &grid) {
+  if (m_noise == HASHED) {
+    initializeHashed(grid, 0, 0, grid.getRows(), grid.getCols());
+    return;
+  }
+
   std::default_random_engine rng(m_seed);
 
   for (int x = 0; x < grid.getCols(); x++) {
     for (int y = 0; y < grid.getRows(); y++) {
+      uint8_t &type = grid.typeAt(grid.indexOf(x, y));
       if (grid.isBorder(x, y) || (static_cast<int>(rng() % 100) < m_rockRatio))
-        grid.setCell(x, y, SimCellData::ROCK);
+        type = SimCellData::ROCK;
       else
-        grid.setCell(x, y, SimCellData::FLOOR);
+        type = SimCellData::FLOOR;
     }
   }
 }
 
-void CaveGenerator::step(Grid<SimCellData> &grid) {
-  Grid updatedGrid(grid);
+void CaveGenerator::initializeHashed(Grid<SimCellData> &area, int x0, int y0,
+                                     int worldRows, int worldCols) {
+  // Cells do not depend on each other, so rows are split among the threads
+  parallelRanges(0, area.getRows(), m_threads, [&](int begin, int end) {
+    for (int y = begin; y < end; y++) {
+      std::span<uint8_t> row = area.getTypeRow(y);
+      int worldY = y0 + y;
 
-  for (int x = 0; x < grid.getCols(); x++) {
-    for (int y = 0; y < grid.getRows(); y++) {
-      std::vector<Cell<SimCellData>> neighbourhood;
+      for (int x = 0; x < area.getCols(); x++) {
+        int worldX = x0 + x;
+        bool border = worldX == 0 || worldY == 0 || worldX == worldCols - 1 ||
+                      worldY == worldRows - 1;
 
-      if (m_mode == MOORE) {
-        neighbourhood = grid.getMooreNeighbourhood(x, y, m_radius);
-      } else {
-        neighbourhood = grid.getNeumannNeighbourhood(x, y, m_radius);
+        uint64_t hash = ValueNoise::hash(static_cast<uint32_t>(m_seed),
+                                         worldX, worldY);
+        if (border || static_cast<int>(hash % 100) < m_rockRatio)
+          row[x] = SimCellData::ROCK;
+        else
+          row[x] = SimCellData::FLOOR;
       }
+    }
+  });
+}
 
-      if (grid.isBorder(x, y)) {
-        // Border cells are always rock
-        updatedGrid.setCell(x, y, SimCellData::ROCK);
-      } else {
-        int neighbours = countNearbyRocks(neighbourhood);
+std::string CaveGenerator::cacheKey(int rows, int cols) const {
+  // The threshold is part of the rule, and the threads do not affect caves.
+  // Chunks do not change the cells either, but the steps reported are those
+  // of the chunk that changed the longest.
+  int chunkSize = m_backend == AUTOMATON && m_noise == HASHED ? m_chunkSize : 0;
+  return std::to_string(rows) + "x" + std::to_string(cols) +
+         " seed=" + std::to_string(m_seed) +
+         " backend=" + std::to_string(m_backend) +
+         " scale=" + std::to_string(m_noiseScale) +
+         " octaves=" + std::to_string(m_noiseOctaves) +
+         " noise=" + std::to_string(m_noise) +
+         " rocks=" + std::to_string(m_rockRatio) +
+         " steps=" + std::to_string(m_steps) +
+         " mode=" + std::to_string(m_mode) +
+         " radius=" + std::to_string(m_radius) +
+         " rule=" + getEvolutionRule().toString() +
+         " minRegion=" + std::to_string(m_minRegionSize) +
+         " largestRegion=" + std::to_string(m_keepLargestRegion) +
+         " chunk=" + std::to_string(chunkSize);
+}
+
+bool CaveGenerator::reportStep(int step) {
+  // Speculative caves and chunks are not shown
+  if (!m_reportingSteps)
+    return false;
+
+  emit progressUpdated(step, m_steps);
+
+  if (m_previewInterval <= 0 || m_previewTimer.elapsed() < m_previewInterval)
+    return false;
+
+  m_previewTimer.restart();
+  return true;
+}
+
+int CaveGenerator::countRocks(const Grid<SimCellData> &grid, int x, int y,
+                              int radius) const {
+  int neighbours = 0;
+  auto countRock = [&](int i, int j) {
+    if (grid.typeAt(grid.indexOf(i, j)) == SimCellData::ROCK)
+      neighbours++;
+  };
+
+  if (m_mode == MOORE) {
+    grid.visitMooreNeighbourhood(x, y, radius, countRock);
+  } else {
+    grid.visitNeumannNeighbourhood(x, y, radius, countRock);
+  }
+
+  return neighbours;
+}
+
+int CaveGenerator::maxRockCount(int rows, int cols) const {
+  // Neighbourhoods never hold more cells than the grid, so larger radii
+  // cannot raise the count and would only overflow
+  long long radius = std::min(m_radius, 1 << 16);
+  long long neighbours = 2 * radius * (radius + 1);
+  if (m_mode == MOORE)
+    neighbours = (2 * radius + 1) * (2 * radius + 1) - 1;
+
+  long long others = std::max(0LL, static_cast<long long>(rows) * cols - 1);
+  return std::min(neighbours, others);
+}
+
+template <CaveGenerator::Mode MODE, int RADIUS>
+bool CaveGenerator::stepTile(const Grid<SimCellData> &grid,
+                             Grid<SimCellData> &updatedGrid,
+                             const CaveRule::Table &rule,
+                             TileFrontier::Tile tile) {
+  const uint8_t *types = grid.getTypePlane().data();
+  int rows = grid.getRows();
+  int cols = grid.getCols();
+  std::array<uint8_t, TileFrontier::TILE_SIZE> counts;
+  bool changed = false;
+
+  for (int y = tile.y0; y < tile.y1; y++) {
+    // Neighbourhoods entirely within the grid need no bounds checks
+    int begin = tile.x0;
+    int end = tile.x0;
+    if (y >= RADIUS && y < rows - RADIUS) {
+      begin = std::max(tile.x0, RADIUS);
+      end = std::max(begin, std::min(tile.x1, cols - RADIUS));
+    }
+
+    countRow<MODE, RADIUS>(types + y * cols, cols, begin, end, counts.data());
+
+    TileFrontier::Tile row = {tile.x0, y, tile.x1, y + 1};
+    changed |= applyRule(grid, updatedGrid, rule, row, [&](int x, int y) {
+      if (x >= begin && x < end)
+        return static_cast<int>(counts[x - begin]);
+
+      return countRocks(grid, x, y, RADIUS);
+    });
+  }
+
+  return changed;
+}
 
-        if (neighbours >= m_threshold) {
-          updatedGrid.setCell(x, y, SimCellData::Type::ROCK);
-        } else {
-          updatedGrid.setCell(x, y, SimCellData::Type::FLOOR);
-        }
+CaveGenerator::TileKernel CaveGenerator::findKernel(Mode mode, int radius) {
+  // Taking the addresses instantiates the kernels
+  static const TileKernel kernels[2][maxSpecializedRadius] = {
+      {&CaveGenerator::stepTile<MOORE, 1>, &CaveGenerator::stepTile<MOORE, 2>,
+       &CaveGenerator::stepTile<MOORE, 3>},
+      {&CaveGenerator::stepTile<NEUMANN, 1>,
+       &CaveGenerator::stepTile<NEUMANN, 2>,
+       &CaveGenerator::stepTile<NEUMANN, 3>}};
+
+  if (radius < 1 || radius > maxSpecializedRadius)
+    return nullptr;
+
+  return kernels[mode][radius - 1];
+}
+
+void CaveGenerator::step(const Grid<SimCellData> &grid,
+                         Grid<SimCellData> &updatedGrid,
+                         const CaveRule::Table &rule, TileFrontier &frontier,
+                         const std::vector<int> &tiles) {
+  std::span<const uint8_t> types = grid.getTypePlane();
+  int rows = grid.getRows();
+  int cols = grid.getCols();
+
+  // Radii past the extent of the grid all cover the same cells
+  int radius = std::min(m_radius, rows + cols);
+
+  auto isRock = [&](int x, int y) {
+    return types[y * cols + x] == SimCellData::ROCK ? 1 : 0;
+  };
+
+  // Tiles are independent of each other and are split among the threads
+  auto evolve = [&](auto stepTile) {
+    parallelRanges(0, tiles.size(), m_threads, [&](int begin, int end) {
+      for (int k = begin; k < end && !isSuperseded(); k++) {
+        if (stepTile(frontier.getTile(tiles[k])))
+          frontier.markChanged(tiles[k]);
       }
+    });
+  };
+
+  auto evolveCounting = [&](auto countRocks) {
+    evolve([&](TileFrontier::Tile tile) {
+      return applyRule(grid, updatedGrid, rule, tile, countRocks);
+    });
+  };
+
+  if (TileKernel kernel = findKernel(m_mode, radius)) {
+    evolve([&](TileFrontier::Tile tile) {
+      return (this->*kernel)(grid, updatedGrid, rule, tile);
+    });
+  } else if (m_mode == MOORE && radius > maxSpecializedRadius) {
+    // Large neighbourhoods are counted in constant time through prefix sums
+    SummedAreaTable table;
+    table.build(types, rows, cols, m_threads);
+
+    evolveCounting([&](int x, int y) {
+      return table.count(x - radius, y - radius, x + radius, y + radius) -
+             isRock(x, y);
+    });
+  } else if (m_mode == NEUMANN && radius > maxSpecializedRadius) {
+    DiamondSumTable table;
+    table.build(types, rows, cols);
+
+    evolveCounting([&](int x, int y) {
+      return table.count(x, y, radius) - isRock(x, y);
+    });
+  } else {
+    evolveCounting(
+        [&](int x, int y) { return countRocks(grid, x, y, radius); });
+  }
+}
+
+int CaveGenerator::simulateBits(Grid<SimCellData> &grid) {
+  BitGrid current(grid.getRows(), grid.getCols());
+  BitGrid next(grid.getRows(), grid.getCols());
+  TileFrontier frontier(grid.getRows(), grid.getCols(), 1);
+  CaveRule rule = getEvolutionRule();
+  uint16_t birth = rule.getBirthMask();
+  uint16_t survival = rule.getSurvivalMask();
+  int steps = 0;
+
+  current.load(grid.getTypePlane());
+  for (; steps < m_steps; steps++) {
+    const std::vector<int> &tiles = frontier.advance();
+
+    parallelRanges(0, tiles.size(), m_threads, [&](int begin, int end) {
+      for (int k = begin; k < end && !isSuperseded(); k++) {
+        // Tiles are exactly one word wide
+        TileFrontier::Tile tile = frontier.getTile(tiles[k]);
+        int word = tile.x0 / TileFrontier::TILE_SIZE;
+
+        if (next.stepMoore(current, birth, survival, tile.y0, tile.y1, word,
+                           word + 1))
+          frontier.markChanged(tiles[k]);
+      }
+    });
+
+    // Further steps would not change anything
+    if (!frontier.anyChanged() || isSuperseded())
+      break;
+
+    std::swap(current, next);
+
+    if (reportStep(steps + 1)) {
+      Grid<SimCellData> preview(grid.getRows(), grid.getCols());
+      current.store(preview.getTypePlane());
+      emit previewReady(preview);
     }
   }
+  current.store(grid.getTypePlane());
+
+  return steps;
+}
+
+int CaveGenerator::simulate(Grid<SimCellData> &grid) {
+  // Radius 1 Moore neighbourhoods have a much faster bit-parallel
+  // implementation
+  if (m_mode == MOORE && m_radius == 1)
+    return simulateBits(grid);
+
+  // Both buffers persist across iterations and swap roles after each step.
+  // Tiles that are not evaluated hold the same cells in both buffers.
+  Grid<SimCellData> updatedGrid(grid.getRows(), grid.getCols());
+  TileFrontier frontier(grid.getRows(), grid.getCols(), m_radius);
+  CaveRule::Table rule(getEvolutionRule(),
+                       maxRockCount(grid.getRows(), grid.getCols()));
+  int steps = 0;
+
+  for (; steps < m_steps; steps++) {
+    step(grid, updatedGrid, rule, frontier, frontier.advance());
+
+    // Further steps would not change anything
+    if (!frontier.anyChanged() || isSuperseded())
+      break;
+
+    std::swap(grid, updatedGrid);
+
+    if (reportStep(steps + 1))
+      emit previewReady(grid);
+  }
 
-  grid = updatedGrid;
+  return steps;
 }
 
-void CaveGenerator::simulate(Grid<SimCellData> &grid) {
-  for (int i = 0; i < m_steps; i++) {
-    step(grid);
+std::vector<int> CaveGenerator::fillRegions(Grid<SimCellData> &grid) {
+  RegionLabeler labeler;
+  labeler.label(grid.getTypePlane(), grid.getRows(), grid.getCols(),
+                m_threads);
+
+  const std::vector<int> &sizes = labeler.getSizes();
+  int largest = std::max_element(sizes.begin(), sizes.end()) - sizes.begin();
+
+  std::vector<bool> keep(sizes.size());
+  std::vector<int> kept;
+  for (int region = 0; region < labeler.getRegionCount(); region++) {
+    keep[region] = sizes[region] >= m_minRegionSize &&
+                   (!m_keepLargestRegion || region == largest);
+    if (keep[region])
+      kept.push_back(sizes[region]);
   }
+
+  std::span<const RegionLabeler::Run> runs = labeler.getRuns();
+  std::span<const int> labels = labeler.getRunLabels();
+
+  parallelRanges(0, runs.size(), m_threads, [&](int begin, int end) {
+    for (int run = begin; run < end; run++) {
+      if (!keep[labels[run]]) {
+        std::span<uint8_t> row = grid.getTypeRow(runs[run].y);
+        std::fill(row.begin() + runs[run].x0, row.begin() + runs[run].x1,
+                  SimCellData::ROCK);
+      }
+    }
+  });
+
+  std::ranges::sort(kept, std::greater<>());
+  return kept;
 }
 
 void CaveGenerator::resetParams() {
@@ -91,4 +705,17 @@ void CaveGenerator::resetParams() {
   m_threshold = 5;
   m_steps = 8;
   m_radius = 1;
+  m_threads = defaultThreads();
+  m_rule.reset();
+  m_minRegionSize = 0;
+  m_keepLargestRegion = false;
+  m_previewInterval = 0;
+  m_noise = SEQUENTIAL;
+  m_chunkSize = 0;
+  m_backend = AUTOMATON;
+  m_noiseScale = 32;
+  m_noiseOctaves = 4;
+  m_prefetchCount = 0;
+  setCacheBudget(defaultCacheBudget);
+  setCacheDirectory(QString());
 }
@@ -1,10 +1,18 @@
 #ifndef CAVEGEN_H
 #define CAVEGEN_H
 
-#include "grid.h"
-#include "sim_cell_data.h"
+#include "cave_cache.h"
+#include "cave_rule.h"
+#include "sim_grid.h"
+#include "tile_frontier.h"
+#include <QElapsedTimer>
 #include <QObject>
+#include <algorithm>
+#include <atomic>
+#include <deque>
 #include <mutex>
+#include <optional>
+#include <thread>
 
 /*
  * Generates 2D caves trough the use of cellular automata.
@@ -18,6 +26,19 @@ public:
    */
   enum Mode { MOORE, NEUMANN };
 
+  /*
+   * Sources of the initial configuration: a random number generator running
+   * over the whole cave, or a hash of the seed and the cell coordinates,
+   * which allows generating any part of a cave on its own.
+   */
+  enum Noise { SEQUENTIAL, HASHED };
+
+  /*
+   * Ways of generating caves: evolving the initial configuration with the
+   * CA, or thresholding fractal value noise in a single pass.
+   */
+  enum Backend { AUTOMATON, FRACTAL_NOISE };
+
   /*
    *  Creates a cave generator with the following parameters:
    *  - seed: seed for the initial configuration;
@@ -84,6 +105,135 @@ public:
    */
   std::pair<int, int> getRadiusRange() const { return std::pair{0, INT_MAX}; }
 
+  /*
+   * Returns the number of threads used to evolve the cave.
+   */
+  int getThreads() const { return m_threads; }
+
+  /*
+   * Returns a pair containing the minimum and maximum values for the threads
+   * parameter.
+   */
+  std::pair<int, int> getThreadsRange() const { return {1, 256}; }
+
+  /*
+   * Returns the minimum size of the floor regions kept in the cave.
+   */
+  int getMinRegionSize() const { return m_minRegionSize; }
+
+  /*
+   * Returns a pair containing the minimum and maximum values for the
+   * minRegionSize parameter.
+   */
+  std::pair<int, int> getMinRegionSizeRange() const { return {0, INT_MAX}; }
+
+  /*
+   * Returns true if only the largest floor region is kept in the cave.
+   */
+  bool isKeepingLargestRegion() const { return m_keepLargestRegion; }
+
+  /*
+   * Returns the minimum time between previews of the cave being generated,
+   * in milliseconds, with 0 meaning no previews.
+   */
+  int getPreviewInterval() const { return m_previewInterval; }
+
+  /*
+   * Returns a pair containing the minimum and maximum values for the
+   * previewInterval parameter.
+   */
+  std::pair<int, int> getPreviewIntervalRange() const { return {0, 60000}; }
+
+  /*
+   * Returns the memory budget of the cave cache, in megabytes.
+   */
+  int getCacheBudget() const { return m_cache.getMemoryBudget() >> 20; }
+
+  /*
+   * Returns a pair containing the minimum and maximum values for the
+   * cacheBudget parameter.
+   */
+  std::pair<int, int> getCacheBudgetRange() const { return {0, 4096}; }
+
+  /*
+   * Returns the directory of the on-disk cave cache, empty if disabled.
+   */
+  QString getCacheDirectory() const {
+    return QString::fromStdString(m_cache.getDirectory());
+  }
+
+  /*
+   * Returns the number of neighbouring caves generated speculatively after
+   * each request.
+   */
+  int getPrefetchCount() const { return m_prefetchCount; }
+
+  /*
+   * Returns a pair containing the minimum and maximum values for the
+   * prefetchCount parameter.
+   */
+  std::pair<int, int> getPrefetchCountRange() const { return {0, 16}; }
+
+  /*
+   * Returns the source of the initial configuration.
+   */
+  Noise getNoise() const { return m_noise; }
+
+  /*
+   * Returns the side of the chunks caves are generated in, with 0 meaning
+   * the whole cave at once.
+   */
+  int getChunkSize() const { return m_chunkSize; }
+
+  /*
+   * Returns a pair containing the minimum and maximum values for the
+   * chunkSize parameter.
+   */
+  std::pair<int, int> getChunkSizeRange() const { return {0, 65536}; }
+
+  /*
+   * Returns the way caves are generated.
+   */
+  Backend getBackend() const { return m_backend; }
+
+  /*
+   * Returns the period of the coarsest octave of fractal noise, in cells.
+   */
+  int getNoiseScale() const { return m_noiseScale; }
+
+  /*
+   * Returns a pair containing the minimum and maximum values for the
+   * noiseScale parameter.
+   */
+  std::pair<int, int> getNoiseScaleRange() const { return {1, 4096}; }
+
+  /*
+   * Returns the number of octaves of fractal noise.
+   */
+  int getNoiseOctaves() const { return m_noiseOctaves; }
+
+  /*
+   * Returns a pair containing the minimum and maximum values for the
+   * noiseOctaves parameter.
+   */
+  std::pair<int, int> getNoiseOctavesRange() const { return {1, 8}; }
+
+  /*
+   * Returns the custom evolution rule, or an empty string if cells follow
+   * the threshold rule.
+   */
+  QString getRule() const {
+    return m_rule ? QString::fromStdString(m_rule->toString()) : QString();
+  }
+
+  /*
+   * Returns the evolution rule in use, which is the threshold rule unless a
+   * custom rule is set.
+   */
+  CaveRule getEvolutionRule() const {
+    return m_rule ? *m_rule : CaveRule::threshold(m_threshold);
+  }
+
   /*
    *  Sets the seed to `seed`.
    */
@@ -110,16 +260,162 @@ public:
   void setRadius(int radius) { m_radius = radius; }
 
   /*
-   * Resets all parameters to their default values.
+   * Sets the evolution rule to `rule`, written as described in `CaveRule`.
+   * An empty rule restores the threshold rule, invalid rules are ignored.
+   */
+  void setRule(const QString &rule) {
+    if (rule.trimmed().isEmpty()) {
+      m_rule.reset();
+    } else if (std::optional<CaveRule> parsed =
+                   CaveRule::parse(rule.toStdString())) {
+      m_rule = parsed;
+    }
+  }
+
+  /*
+   * Sets the minimum size of the floor regions kept in the cave to
+   * `minRegionSize`. Smaller regions are filled with rock, and 0 disables
+   * the filling.
+   */
+  void setMinRegionSize(int minRegionSize) { m_minRegionSize = minRegionSize; }
+
+  /*
+   * Sets whether only the largest floor region is kept in the cave, filling
+   * all the others with rock.
+   */
+  void setKeepLargestRegion(bool keep) { m_keepLargestRegion = keep; }
+
+  /*
+   * Sets the minimum time between previews of the cave being generated to
+   * `previewInterval` milliseconds, with 0 disabling them.
+   */
+  void setPreviewInterval(int previewInterval) {
+    m_previewInterval = previewInterval;
+  }
+
+  /*
+   * Sets the memory budget of the cave cache to `megabytes`, with 0 keeping
+   * no cave in memory.
+   */
+  void setCacheBudget(int megabytes) {
+    m_cache.setMemoryBudget(static_cast<size_t>(std::max(megabytes, 0)) << 20);
+  }
+
+  /*
+   * Sets the directory of the on-disk cave cache to `directory`, with an
+   * empty directory disabling it.
+   */
+  void setCacheDirectory(const QString &directory) {
+    m_cache.setDirectory(directory.trimmed().toStdString());
+  }
+
+  /*
+   * Sets the number of neighbouring caves generated speculatively after each
+   * request to `prefetchCount`, with 0 disabling the speculation. The caves
+   * differ from the requested one by one step in a single parameter, seeds
+   * first, and are stored in the cave cache.
+   */
+  void setPrefetchCount(int prefetchCount) { m_prefetchCount = prefetchCount; }
+
+  /*
+   * Sets the side of the chunks caves are generated in to `chunkSize`, with
+   * 0 generating the whole cave at once. Chunks are only used with hashed
+   * noise, with which they produce the same caves as whole generation.
+   */
+  void setChunkSize(int chunkSize) { m_chunkSize = chunkSize; }
+
+  /*
+   * Sets the period of the coarsest octave of fractal noise to `noiseScale`
+   * cells.
+   */
+  void setNoiseScale(int noiseScale) { m_noiseScale = noiseScale; }
+
+  /*
+   * Sets the number of octaves of fractal noise to `noiseOctaves`.
+   */
+  void setNoiseOctaves(int noiseOctaves) { m_noiseOctaves = noiseOctaves; }
+
+  /*
+   * Sets the number of threads used to evolve the cave to `threads`.
+   */
+  void setThreads(int threads) {
+    if (threads < getThreadsRange().first || threads > getThreadsRange().second)
+      return;
+
+    m_threads = threads;
+  }
+
+  /*
+   * Returns the default number of threads, one per hardware thread.
+   */
+  static int defaultThreads() {
+    return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  }
+
+  /*
+   * Generates the part of a cave with `worldRows` rows and `worldCols`
+   * columns starting at column `x0` and row `y0` into `chunk`, using hashed
+   * noise. Only the chunk and a halo of steps × radius cells around it are
+   * evolved, which are the only cells that can affect it, so the result is
+   * the same as for the whole cave generated at once. Returns the number of
+   * steps that changed the chunk and its halo.
+   */
+  int generateChunk(Grid<SimCellData> &chunk, int x0, int y0, int worldRows,
+                    int worldCols);
+
+  /*
+   * Generates a cave with `rows` rows and `cols` columns into a cave file at
+   * `path`, replacing any existing one, for the request with ticket
+   * `ticket`, see `requestTicket`. Caves evolved chunk by chunk from hashed
+   * noise without filling regions are written chunk by chunk, so they never
+   * have to fit in memory. Other caves go through the cave cache like those
+   * of `generateCave`. Returns the number of steps that changed the cave,
+   * or nothing if the file could not be written or the request was
+   * superseded meanwhile.
+   */
+  std::optional<int> generateCaveFile(const std::string &path, int rows,
+                                      int cols, int ticket);
+
+  /*
+   * Returns the ticket of a new cave request, superseding all the earlier
+   * ones. Superseded requests are dropped if still queued, or stop at the
+   * next tile if in progress, without emitting a cave. Can be called from
+   * any thread.
+   */
+  int requestTicket() { return ++m_latestTicket; }
+
+  /*
+   * Default memory budget of the cave cache, in megabytes.
+   */
+  static const int defaultCacheBudget = 64;
+
+  /*
+   * Resets all parameters to their default values. Must be called from the
+   * generator's thread, as it changes the cave cache.
    */
   void resetParams();
 
 public slots:
   /*
-   *  Generates a new cave based on the generator's parameters.
+   *  Generates a new cave based on the generator's parameters, for the
+   *  request with ticket `ticket`, see `requestTicket`.
    *  Once the cave is ready, it is broadcasted through a `caveReady` signal
    */
-  void generateCave(int rows, int cols);
+  void generateCave(int rows, int cols, int ticket);
+
+  /*
+   *  Generates a new cave like `generateCave`, but into the cave file at
+   *  `path`, see `generateCaveFile`. Once the file is written, it is
+   *  reported through a `caveFileSaved` signal.
+   */
+  void saveCave(QString path, int rows, int cols, int ticket);
+
+  /*
+   *  Reads the cave file at `path` for the request with ticket `ticket`,
+   *  see `requestTicket`, and broadcasts its cave through a `gridReady`
+   *  signal like a generated one, after a `caveFileOpened` signal.
+   */
+  void openCave(QString path, int ticket);
 
   /*
    * Sets the neighbourhood type to MOORE.
@@ -137,9 +433,69 @@ public slots:
       m_mode = NEUMANN;
   }
 
+  /*
+   * Sets the source of the initial configuration to `noise`, one of the
+   * Noise values.
+   */
+  void setNoise(int noise) {
+    if (noise == SEQUENTIAL || noise == HASHED)
+      m_noise = static_cast<Noise>(noise);
+  }
+
+  /*
+   * Sets the way caves are generated to `backend`, one of the Backend
+   * values.
+   */
+  void setBackend(int backend) {
+    if (backend == AUTOMATON || backend == FRACTAL_NOISE)
+      m_backend = static_cast<Backend>(backend);
+  }
+
 signals:
   void gridReady(Grid<SimCellData> grid);
 
+  /*
+   * Emitted before `gridReady` with the number of steps that changed the
+   * cave, which is lower than the steps parameter when the cave settles
+   * early.
+   */
+  void stepsPerformed(int steps);
+
+  /*
+   * Emitted after each step of the cave generation with the number of steps
+   * performed so far out of `steps`.
+   */
+  void progressUpdated(int step, int steps);
+
+  /*
+   * Emitted with the cave being generated, at most once per preview
+   * interval.
+   */
+  void previewReady(Grid<SimCellData> grid);
+
+  /*
+   * Emitted before `gridReady` with the sizes of the floor regions left in
+   * the cave, largest first, whenever regions are filled.
+   */
+  void regionsFound(std::vector<int> sizes);
+
+  /*
+   * Emitted once the cave file at `path` is written, with the number of
+   * steps that changed its cave.
+   */
+  void caveFileSaved(QString path, int steps);
+
+  /*
+   * Emitted before `gridReady` when the cave comes from the cave file at
+   * `path`, with the number of steps that changed its cave.
+   */
+  void caveFileOpened(QString path, int steps);
+
+  /*
+   * Emitted when the cave file at `path` cannot be written or read.
+   */
+  void caveFileFailed(QString path);
+
 private:
   int m_seed;          // Seed for the initial configuration
   int m_rockRatio;     // Amount of rocks in the initial configuration
@@ -147,24 +503,253 @@ private:
   int m_steps;         // Number of iteration steps
   Mode m_mode = MOORE; // Neighbourhood mode
   int m_radius;        // Neighbourhood radius
+  int m_threads;       // Number of threads evolving the cave
+
+  std::optional<CaveRule> m_rule;   // Custom evolution rule, if any
+  int m_minRegionSize = 0;          // Minimum size of the floor regions
+  bool m_keepLargestRegion = false; // Whether to keep only the largest region
+  int m_previewInterval = 0;        // Minimum time between previews, in ms
+  Noise m_noise = SEQUENTIAL;       // Source of the initial configuration
+  int m_chunkSize = 0;              // Side of the chunks, 0 for whole caves
+  Backend m_backend = AUTOMATON;    // Way caves are generated
+  int m_noiseScale = 32;            // Period of the coarsest noise octave
+  int m_noiseOctaves = 4;           // Number of noise octaves
+
+  std::atomic<int> m_latestTicket = 0; // Ticket of the latest request
+  int m_ticket = 0;                    // Ticket of the cave being generated
+  QElapsedTimer m_previewTimer;        // Time since the last preview
+
+  CaveCache m_cache; // Previously generated caves
+
+  /*
+   * Parameters varied by the speculative generation.
+   */
+  struct Variant {
+    int seed;
+    int rockRatio;
+    int threshold;
+    int steps;
+    int radius;
+  };
+
+  int m_prefetchCount = 0;             // Caves to generate speculatively
+  std::deque<Variant> m_prefetchQueue; // Variants left to generate
+  int m_prefetchRows = 0;              // Rows of the speculative caves
+  int m_prefetchCols = 0;              // Columns of the speculative caves
+  bool m_reportingSteps = true;        // Whether steps are reported
 
   /*
    *  Sets up the initial state of `grid`, randomly assigning a state to
    *  each cell based on the results of a random number generator seeded with
    *  `m_seed` and the ratio `m_rockRatio`, which decides the likeliness of a
-   *  cell to be initialized as rock
+   *  cell to be initialized as rock, or on hashed noise if `m_noise` is
+   *  HASHED.
    */
   void initialize(Grid<SimCellData> &grid);
 
   /*
-   *  Performs one step of the CA simulation on `grid`
+   *  Sets up the initial state of `area`, the part of a cave with
+   *  `worldRows` rows and `worldCols` columns starting at column `x0` and
+   *  row `y0`, using hashed noise. Each cell is rock with a likeliness of
+   *  `m_rockRatio` based on a hash of `m_seed` and its coordinates, or if
+   *  it lies on the border of the cave.
+   */
+  void initializeHashed(Grid<SimCellData> &area, int x0, int y0,
+                        int worldRows, int worldCols);
+
+  /*
+   *  Generates `grid` in a single pass, making rock the cells where fractal
+   *  value noise seeded with `m_seed` falls below `m_rockRatio` percent, as
+   *  well as the border cells.
+   */
+  void generateNoise(Grid<SimCellData> &grid);
+
+  /*
+   *  Generates a cave with `rows` rows and `cols` columns chunk by chunk,
+   *  see `generateChunk`, calling `store(chunk, x0, y0)` with each chunk and
+   *  the column and row it starts at. Returns the largest number of steps
+   *  that changed a chunk, or nothing if the request was superseded
+   *  meanwhile.
+   */
+  template <typename F>
+  std::optional<int> generateChunks(int rows, int cols, F &&store) {
+    int steps = 0;
+
+    for (int y0 = 0; y0 < rows; y0 += m_chunkSize) {
+      for (int x0 = 0; x0 < cols; x0 += m_chunkSize) {
+        Grid<SimCellData> chunk(std::min(m_chunkSize, rows - y0),
+                                std::min(m_chunkSize, cols - x0));
+        steps = std::max(steps, generateChunk(chunk, x0, y0, rows, cols));
+
+        if (isSuperseded())
+          return std::nullopt;
+
+        store(chunk, x0, y0);
+      }
+    }
+
+    return steps;
+  }
+
+  /*
+   * Evaluates one tile of a step of the CA simulation, see `stepTile`.
+   */
+  using TileKernel = bool (CaveGenerator::*)(const Grid<SimCellData> &,
+                                             Grid<SimCellData> &,
+                                             const CaveRule::Table &,
+                                             TileFrontier::Tile);
+
+  /*
+   * Largest radius with kernels specialized at compile time.
+   */
+  static const int maxSpecializedRadius = 3;
+
+  /*
+   *  Generates a cave with `rows` rows and `cols` columns and stores it in
+   *  the cave cache under `key`. Returns nothing if the request was
+   *  superseded meanwhile.
+   */
+  std::optional<CaveCache::Cave> createCave(int rows, int cols,
+                                            const std::string &key);
+
+  /*
+   *  Returns the parameters varied by the speculative generation.
+   */
+  Variant getVariant() const {
+    return {m_seed, m_rockRatio, m_threshold, m_steps, m_radius};
+  }
+
+  /*
+   *  Sets the parameters varied by the speculative generation to `variant`.
+   */
+  void setVariant(const Variant &variant);
+
+  /*
+   *  Queues the speculative generation of the caves neighbouring the
+   *  current parameters, with `rows` rows and `cols` columns.
+   */
+  void schedulePrefetch(int rows, int cols);
+
+  /*
+   *  Generates the next queued speculative cave, unless a newer request
+   *  superseded the speculation, and posts itself again while the queue is
+   *  not empty. Posting each cave separately lets real requests queued
+   *  meanwhile run first.
+   */
+  void prefetchNext();
+
+  /*
+   *  Returns the key of a cave with `rows` rows and `cols` columns in the
+   *  cave cache, describing every parameter which affects the cave.
+   */
+  std::string cacheKey(int rows, int cols) const;
+
+  /*
+   *  Returns true if the cave being generated was superseded by a newer
+   *  request.
+   */
+  bool isSuperseded() const {
+    return m_ticket != m_latestTicket.load(std::memory_order_relaxed);
+  }
+
+  /*
+   *  Reports that `step` steps were performed and returns true if a preview
+   *  of the cave is due, restarting the preview interval.
+   */
+  bool reportStep(int step);
+
+  /*
+   *  Returns the number of rocks in the neighbourhood of radius `radius`
+   *  around the cell at column `x` and row `y` of `grid`.
+   */
+  int countRocks(const Grid<SimCellData> &grid, int x, int y,
+                 int radius) const;
+
+  /*
+   *  Returns the largest number of rock neighbours a cell of a grid with
+   *  `rows` rows and `cols` columns can have.
+   */
+  int maxRockCount(int rows, int cols) const;
+
+  /*
+   *  Applies the evolution rule in `rule` to the cells of `grid` within
+   *  `tile`, writing the result to `updatedGrid`, for neighbourhoods of type
+   *  MODE and radius RADIUS. Away from the edges the neighbourhoods are
+   *  counted a row at a time with fully unrolled code. Returns true if any
+   *  cell changed.
+   */
+  template <Mode MODE, int RADIUS>
+  bool stepTile(const Grid<SimCellData> &grid, Grid<SimCellData> &updatedGrid,
+                const CaveRule::Table &rule, TileFrontier::Tile tile);
+
+  /*
+   *  Returns the kernel specialized for `mode` and `radius`, or nullptr if
+   *  there is none.
+   */
+  static TileKernel findKernel(Mode mode, int radius);
+
+  /*
+   *  Performs one step of the CA simulation on `grid` following `rule`,
+   *  writing the result to `updatedGrid`. Only the tiles of `frontier`
+   *  listed in `tiles` are evaluated, and those whose cells change are
+   *  marked in `frontier`.
+   */
+  void step(const Grid<SimCellData> &grid, Grid<SimCellData> &updatedGrid,
+            const CaveRule::Table &rule, TileFrontier &frontier,
+            const std::vector<int> &tiles);
+
+  /*
+   *  Applies the evolution rule in `rule` to the cells of `grid` within
+   *  `tile`, writing the result to `updatedGrid`. `countRocks(x, y)` returns
+   *  the number of rocks in the neighbourhood of the cell at column `x` and
+   *  row `y`. Returns true if any cell changed.
+   */
+  template <typename F>
+  bool applyRule(const Grid<SimCellData> &grid, Grid<SimCellData> &updatedGrid,
+                 const CaveRule::Table &rule, TileFrontier::Tile tile,
+                 F &&countRocks) {
+    bool changed = false;
+
+    for (int y = tile.y0; y < tile.y1; y++) {
+      std::span<const uint8_t> row = grid.getTypeRow(y);
+      std::span<uint8_t> updatedRow = updatedGrid.getTypeRow(y);
+
+      for (int x = tile.x0; x < tile.x1; x++) {
+        if (grid.isBorder(x, y)) {
+          // Border cells are always rock
+          updatedRow[x] = SimCellData::ROCK;
+        } else {
+          updatedRow[x] = rule.next(row[x], countRocks(x, y));
+        }
+
+        changed |= updatedRow[x] != row[x];
+      }
+    }
+
+    return changed;
+  }
+
+  /*
+   *  Performs up to `m_steps` steps of the radius 1 Moore CA simulation on
+   *  `grid` using a bit-packed copy of its cells. Returns the number of
+   *  steps that changed the cave.
+   */
+  int simulateBits(Grid<SimCellData> &grid);
+
+  /*
+   *  Performs up to `m_steps` steps of the CA simulation on `grid`, only
+   *  re-evaluating the areas within reach of the last step's changes and
+   *  stopping once the cave no longer changes. Returns the number of steps
+   *  that changed the cave.
    */
-  void step(Grid<SimCellData> &grid);
+  int simulate(Grid<SimCellData> &grid);
 
   /*
-   *  Performs `m_steps` steps of the CA simulation on `m_grid`
+   *  Fills with rock the floor regions of `grid` smaller than
+   *  `m_minRegionSize` and, if `m_keepLargestRegion` is set, all but the
+   *  largest one. Returns the sizes of the remaining regions, largest first.
    */
-  void simulate(Grid<SimCellData> &grid);
+  std::vector<int> fillRegions(Grid<SimCellData> &grid);
 };
 
 #endif
@@ -0,0 +1,171 @@
+#include "cave_rule.h"
+#include "sim_cell_data.h"
+#include <algorithm>
+#include <cctype>
+
+CaveRule::Table::Table(const CaveRule &rule, int maxCount) {
+  // Past the largest finite bound, every count falls in the same ranges
+  int largest = 0;
+  for (const std::vector<Range> *ranges : {&rule.m_birth, &rule.m_survival}) {
+    for (Range range : *ranges) {
+      largest = std::max(largest, range.min);
+      if (range.max != INT_MAX)
+        largest = std::max(largest, range.max);
+    }
+  }
+
+  // Counts above `maxCount` never occur, so larger bounds need no entries
+  m_stride = std::min(largest, std::max(maxCount, 0) - 1) + 2;
+  m_next.resize(2 * m_stride);
+
+  for (int rock = 0; rock <= 1; rock++) {
+    for (int count = 0; count < m_stride; count++) {
+      m_next[rock * m_stride + count] = rule.isRock(rock, count)
+                                            ? SimCellData::ROCK
+                                            : SimCellData::FLOOR;
+    }
+  }
+}
+
+CaveRule CaveRule::threshold(int threshold) {
+  CaveRule rule;
+  rule.m_birth = {{threshold, INT_MAX}};
+  rule.m_survival = {{threshold, INT_MAX}};
+  return rule;
+}
+
+std::optional<CaveRule> CaveRule::parse(const std::string &text) {
+  std::string rule;
+  for (char c : text) {
+    if (!isspace(static_cast<unsigned char>(c)))
+      rule += toupper(static_cast<unsigned char>(c));
+  }
+
+  size_t slash = rule.find('/');
+  if (slash == std::string::npos)
+    return std::nullopt;
+
+  std::string birth = rule.substr(0, slash);
+  std::string survival = rule.substr(slash + 1);
+  if (birth.empty() || birth[0] != 'B' || survival.empty() ||
+      survival[0] != 'S')
+    return std::nullopt;
+
+  std::optional<std::vector<Range>> birthCounts = parseCounts(birth.substr(1));
+  std::optional<std::vector<Range>> survivalCounts =
+      parseCounts(survival.substr(1));
+  if (!birthCounts || !survivalCounts)
+    return std::nullopt;
+
+  CaveRule parsed;
+  parsed.m_birth = *birthCounts;
+  parsed.m_survival = *survivalCounts;
+  return parsed;
+}
+
+bool CaveRule::isRock(bool rock, int count) const {
+  return contains(rock ? m_survival : m_birth, count);
+}
+
+std::string CaveRule::toString() const {
+  return "B" + formatCounts(m_birth) + "/S" + formatCounts(m_survival);
+}
+
+bool CaveRule::contains(const std::vector<Range> &ranges, int count) {
+  return std::any_of(ranges.begin(), ranges.end(), [&](Range range) {
+    return count >= range.min && count <= range.max;
+  });
+}
+
+uint16_t CaveRule::mask(const std::vector<Range> &ranges) {
+  uint16_t bits = 0;
+  for (int count = 0; count <= 8; count++) {
+    if (contains(ranges, count))
+      bits |= 1 << count;
+  }
+
+  return bits;
+}
+
+std::optional<std::vector<CaveRule::Range>>
+CaveRule::parseCounts(const std::string &text) {
+  std::vector<Range> ranges;
+
+  // Single digit notation
+  if (text.find_first_of(",-+") == std::string::npos) {
+    for (char c : text) {
+      if (!isdigit(static_cast<unsigned char>(c)))
+        return std::nullopt;
+      ranges.push_back({c - '0', c - '0'});
+    }
+
+    return ranges;
+  }
+
+  // Comma separated numbers and ranges
+  size_t pos = 0;
+  auto number = [&]() -> std::optional<int> {
+    size_t start = pos;
+    long value = 0;
+    while (pos < text.size() &&
+           isdigit(static_cast<unsigned char>(text[pos]))) {
+      value = value * 10 + (text[pos++] - '0');
+      if (value > INT_MAX - 1)
+        return std::nullopt;
+    }
+
+    if (pos == start)
+      return std::nullopt;
+    return static_cast<int>(value);
+  };
+
+  while (true) {
+    std::optional<int> min = number();
+    if (!min)
+      return std::nullopt;
+
+    Range range = {*min, *min};
+    if (pos < text.size() && text[pos] == '-') {
+      pos++;
+      std::optional<int> max = number();
+      if (!max || *max < *min)
+        return std::nullopt;
+      range.max = *max;
+    }
+
+    if (pos < text.size() && text[pos] == '+') {
+      pos++;
+      range.max = INT_MAX;
+    }
+
+    ranges.push_back(range);
+
+    if (pos == text.size())
+      return ranges;
+    if (text[pos] != ',' || range.max == INT_MAX)
+      return std::nullopt;
+    pos++;
+  }
+}
+
+std::string CaveRule::formatCounts(const std::vector<Range> &ranges) {
+  bool singleDigits = std::all_of(ranges.begin(), ranges.end(), [](Range r) {
+    return r.min <= 9 && r.max == r.min;
+  });
+
+  std::string text;
+  for (size_t i = 0; i < ranges.size(); i++) {
+    Range range = ranges[i];
+
+    if (!singleDigits && i > 0)
+      text += ",";
+
+    text += std::to_string(range.min);
+    if (range.max == INT_MAX)
+      text += "+";
+    else if (range.max != range.min)
+      text += "-" + std::to_string(range.max);
+  }
+
+  return text;
+}
@@ -0,0 +1,117 @@
+#ifndef CAVE_RULE_H
+#define CAVE_RULE_H
+
+#include <climits>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+/*
+ * Outer-totalistic evolution rule for cave generation, made of a birth set
+ * and a survival set of rock neighbour counts. A floor cell turns into rock
+ * if its count is in the birth set, and a rock cell stays rock if its count
+ * is in the survival set.
+ *
+ * Rules are written as "B<counts>/S<counts>". Counts are either single
+ * digits, as in "B5678/S45678", or comma separated numbers and ranges, as
+ * in "B13-24/S12,14-24". A trailing "+" makes the last count open-ended, as
+ * in "B13+/S4,12+".
+ */
+class CaveRule {
+
+public:
+  /*
+   * Ranges of counts [min, max], with max = INT_MAX for open-ended ones.
+   */
+  struct Range {
+    int min;
+    int max;
+  };
+
+  /*
+   * Lookup table mapping the state of a cell and its rock neighbour count to
+   * the cell's next state.
+   */
+  class Table {
+
+  public:
+    /*
+     *  Builds the table for `rule`, for cells with at most `maxCount` rock
+     *  neighbours.
+     */
+    Table(const CaveRule &rule, int maxCount);
+
+    /*
+     *  Returns the next type of a cell of type `type`, either rock or floor,
+     *  with `count` rock neighbours.
+     */
+    uint8_t next(uint8_t type, int count) const {
+      return m_next[type * m_stride + std::min(count, m_stride - 1)];
+    }
+
+  private:
+    int m_stride;                // Entries per state
+    std::vector<uint8_t> m_next; // Next types, by state and count
+  };
+
+  /*
+   *  Creates the rule turning a cell into rock when at least `threshold` of
+   *  its neighbours are rock, whatever its current state.
+   */
+  static CaveRule threshold(int threshold);
+
+  /*
+   *  Parses `rule`, returning nothing if it is not a valid rule.
+   */
+  static std::optional<CaveRule> parse(const std::string &rule);
+
+  /*
+   *  Returns true if a cell in state `rock` with `count` rock neighbours is
+   *  rock after a step.
+   */
+  bool isRock(bool rock, int count) const;
+
+  /*
+   *  Returns a mask with bit k set if a floor cell with k rock neighbours
+   *  turns into rock, for k in [0, 8].
+   */
+  uint16_t getBirthMask() const { return mask(m_birth); }
+
+  /*
+   *  Returns a mask with bit k set if a rock cell with k rock neighbours
+   *  stays rock, for k in [0, 8].
+   */
+  uint16_t getSurvivalMask() const { return mask(m_survival); }
+
+  /*
+   *  Returns the rule in the same notation accepted by `parse`.
+   */
+  std::string toString() const;
+
+private:
+  std::vector<Range> m_birth;    // Counts turning floor into rock
+  std::vector<Range> m_survival; // Counts keeping rocks
+
+  /*
+   *  Returns true if `count` falls in one of `ranges`.
+   */
+  static bool contains(const std::vector<Range> &ranges, int count);
+
+  /*
+   *  Returns the mask of the counts in [0, 8] falling in `ranges`.
+   */
+  static uint16_t mask(const std::vector<Range> &ranges);
+
+  /*
+   *  Parses the counts in `text`, returning nothing if they are invalid.
+   */
+  static std::optional<std::vector<Range>> parseCounts(const std::string &text);
+
+  /*
+   *  Writes `ranges` in rule notation.
+   */
+  static std::string formatCounts(const std::vector<Range> &ranges);
+};
+
+#endif // CAVE_RULE_H
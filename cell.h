@@ -9,7 +9,12 @@ public:
   /*
    * Constructs a cell with the specified coordinates.
    */
-  Cell(int x, int y) : m_x(x), m_y(y){};
+  Cell(int x = 0, int y = 0) : m_x(x), m_y(y){};
+
+  /*
+   * Constructs a cell with the specified coordinates and data.
+   */
+  Cell(int x, int y, T data) : m_x(x), m_y(y), m_data(data){};
 
   /*
    * Returns the x coordinate of the cell.
@@ -26,6 +31,13 @@ public:
    */
   T getData() const { return m_data; }
 
+  /*
+   * Returns a reference to the data associated with the cell, for in-place
+   * updates.
+   */
+  T &data() { return m_data; }
+  const T &data() const { return m_data; }
+
   /*
    * Sets the cell's data to `data`.
    */
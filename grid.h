@@ -2,53 +2,20 @@
 #define GRID_H
 
 #include "cell.h"
+#include <algorithm>
+#include <cassert>
 #include <memory>
+#include <span>
+#include <stdexcept>
 #include <vector>
 
 /*
- * A grid of cells with contents of type T.
+ * Coordinate logic shared by all grid layouts. `Derived` is the concrete grid
+ * type, which must provide `getCell(x, y)`.
  */
-template <typename T> class Grid {
+template <typename Derived, typename T> class GridBase {
 
 public:
-  /*
-   *  Creates a grid with the specified number of rows and columns.
-   */
-  Grid(int rows = 0, int cols = 0) : m_rows(rows), m_cols(cols) {
-    if (rows < 0 || cols < 0)
-      throw std::invalid_argument(
-          "The number of rows and columns cannot be negative.");
-
-    for (int y = 0; y < rows; y++) {
-      for (int x = 0; x < cols; x++) {
-        m_cells.push_back(Cell<T>(x, y));
-      }
-    }
-  }
-
-  /*
-   *  Resizes the grid to be `rows` tall and `cols` wide.
-   *  All contents are discarded.
-   */
-  void resize(int rows, int cols) {
-    if (rows < 0 || cols < 0)
-      throw std::invalid_argument(
-          "The number of rows and columns cannot be negative.");
-
-    m_rows = rows;
-    m_cols = cols;
-
-    std::vector<Cell<T>> newCells;
-
-    for (int y = 0; y < rows; y++) {
-      for (int x = 0; x < cols; x++) {
-        newCells.push_back(Cell<T>(x, y));
-      }
-    }
-
-    m_cells = newCells;
-  }
-
   /*
    *  Computes the Manhattan distance between two points (x1, y1) and (x2, y2).
    */
@@ -61,16 +28,6 @@ public:
     return dx + dy;
   }
 
-  /*
-   *  Sets the cell at column `x` and row `y` to `val`.
-   */
-  void setCell(int x, int y, T val) {
-    if (!areValid(x, y))
-      throw std::invalid_argument("Out of bounds coordinates.");
-
-    m_cells[y * m_cols + x].setData(val);
-  }
-
   /*
    *  Returns true if the cell at column `x` and row `y` is on the grid's
    *  border, false otherwise.
@@ -83,30 +40,74 @@ public:
   }
 
   /*
-   *  Returns the i-th cell.
+   * Returns true if (x,y) is a cell in the grid, false otherwise.
    */
-  Cell<T> getCell(int i) const {
-    if (i < 0 || i >= m_cols * m_rows)
+  bool areValid(int x, int y) const {
+    return x >= 0 && x < m_cols && y >= 0 && y < m_rows;
+  }
+
+  /*
+   *  Calls `visit(i, j)` for each cell (i, j) in the Moore neighbourhood of
+   *  radius `radius` around the cell found at column `x` and row `y`.
+   *  Cells are visited column by column, top to bottom.
+   */
+  template <typename F>
+  void visitMooreNeighbourhood(int x, int y, int radius, F &&visit) const {
+    if (!areValid(x, y))
       throw std::invalid_argument("Out of bounds coordinates.");
 
-    return m_cells[i];
+    int minI = x - std::min(radius, x);
+    int maxI = x + std::min(radius, m_cols - 1 - x);
+    int minJ = y - std::min(radius, y);
+    int maxJ = y + std::min(radius, m_rows - 1 - y);
+
+    for (int i = minI; i <= maxI; i++) {
+      for (int j = minJ; j <= maxJ; j++) {
+        if (i != x || j != y)
+          visit(i, j);
+      }
+    }
   }
 
   /*
-   *  Returns the cell at column `x` and row `y`.
+   *  Calls `visit(i, j)` for each cell (i, j) in the Von Neumann
+   *  neighbourhood of radius `radius` around the cell found at column `x`
+   *  and row `y`. Cells are visited column by column, top to bottom.
    */
-  Cell<T> getCell(int x, int y) const {
+  template <typename F>
+  void visitNeumannNeighbourhood(int x, int y, int radius, F &&visit) const {
     if (!areValid(x, y))
       throw std::invalid_argument("Out of bounds coordinates.");
 
-    return m_cells[y * m_cols + x];
+    int minI = x - std::min(radius, x);
+    int maxI = x + std::min(radius, m_cols - 1 - x);
+
+    for (int i = minI; i <= maxI; i++) {
+      int span = radius - abs(i - x);
+      int minJ = y - std::min(span, y);
+      int maxJ = y + std::min(span, m_rows - 1 - y);
+
+      for (int j = minJ; j <= maxJ; j++) {
+        if (i != x || j != y)
+          visit(i, j);
+      }
+    }
   }
 
   /*
-   * Returns true if (x,y) is a cell in the grid, false otherwise.
+   *  Calls `visit(i, j)` for each of the cells (i, j) ahead of the cell found
+   *  at column `x` and row `y` when facing direction `d`.
    */
-  bool areValid(int x, int y) const {
-    return x >= 0 && x < m_cols && y >= 0 && y < m_rows;
+  template <typename F>
+  void visitDirectionalNeighbourhood(int x, int y, std::pair<int, int> d,
+                                     F &&visit) const {
+    int targetX = x + d.first;
+    int targetY = y + d.second;
+
+    visitMooreNeighbourhood(x, y, 1, [&](int i, int j) {
+      if (abs(i - targetX) + abs(j - targetY) <= 1)
+        visit(i, j);
+    });
   }
 
   /*
@@ -116,17 +117,11 @@ public:
    */
   std::vector<Cell<T>> getMooreNeighbourhood(int x, int y,
                                              int radius = 1) const {
-    if (!areValid(x, y))
-      throw std::invalid_argument("Out of bounds coordinates.");
-
     std::vector<Cell<T>> neighbourhood;
 
-    for (int i = x - radius; i <= x + radius; i++) {
-      for (int j = y - radius; j <= y + radius; j++) {
-        if ((i != x || j != y) && i >= 0 && i < m_cols && j >= 0 && j < m_rows)
-          neighbourhood.push_back(getCell(i, j));
-      }
-    }
+    visitMooreNeighbourhood(x, y, radius, [&](int i, int j) {
+      neighbourhood.push_back(self().getCell(i, j));
+    });
 
     return neighbourhood;
   }
@@ -138,18 +133,11 @@ public:
    */
   std::vector<Cell<T>> getNeumannNeighbourhood(int x, int y,
                                                int radius = 1) const {
-    if (!areValid(x, y))
-      throw std::invalid_argument("Out of bounds coordinates.");
-
     std::vector<Cell<T>> neighbourhood;
 
-    for (int i = x - radius; i <= x + radius; i++) {
-      for (int j = y - radius; j <= y + radius; j++) {
-        if ((i != x || j != y) && i >= 0 && i < m_cols && j >= 0 &&
-            j < m_rows && manhattanDist(x, y, i, j) <= radius)
-          neighbourhood.push_back(getCell(i, j));
-      }
-    }
+    visitNeumannNeighbourhood(x, y, radius, [&](int i, int j) {
+      neighbourhood.push_back(self().getCell(i, j));
+    });
 
     return neighbourhood;
   }
@@ -159,15 +147,11 @@ public:
    * position (x,y) and the direction `d`.
    */
   std::vector<Cell<T>> getDirectionalNeighbourhood(int x, int y,
-                                                   std::pair<int, int> d) {
-    if (!areValid(x, y))
-      throw std::invalid_argument("Out of bounds coordinates.");
-
-    std::vector<Cell<T>> neighbourhood = getMooreNeighbourhood(x, y);
+                                                   std::pair<int, int> d) const {
+    std::vector<Cell<T>> neighbourhood;
 
-    std::erase_if(neighbourhood, [&](Cell<T> cell) {
-      return manhattanDist(cell.getX(), cell.getY(), x + d.first,
-                           y + d.second) > 1;
+    visitDirectionalNeighbourhood(x, y, d, [&](int i, int j) {
+      neighbourhood.push_back(self().getCell(i, j));
     });
 
     return neighbourhood;
@@ -188,9 +172,125 @@ public:
    */
   int getRows() const { return m_rows; }
 
+protected:
+  int m_rows; // Number of rows
+  int m_cols; // Number of columns
+
+  /*
+   *  Sets the dimensions of the grid to `rows` by `cols`.
+   */
+  GridBase(int rows, int cols) { setDimensions(rows, cols); }
+
+  /*
+   *  Sets the dimensions of the grid to `rows` by `cols`.
+   */
+  void setDimensions(int rows, int cols) {
+    if (rows < 0 || cols < 0)
+      throw std::invalid_argument(
+          "The number of rows and columns cannot be negative.");
+
+    m_rows = rows;
+    m_cols = cols;
+  }
+
+private:
+  /*
+   * Returns this grid as its concrete type.
+   */
+  const Derived &self() const { return static_cast<const Derived &>(*this); }
+};
+
+/*
+ * A grid of cells with contents of type T.
+ */
+template <typename T> class Grid : public GridBase<Grid<T>, T> {
+
+public:
+  /*
+   *  Creates a grid with the specified number of rows and columns.
+   */
+  Grid(int rows = 0, int cols = 0) : GridBase<Grid<T>, T>(rows, cols) {
+    for (int y = 0; y < rows; y++) {
+      for (int x = 0; x < cols; x++) {
+        m_cells.push_back(Cell<T>(x, y));
+      }
+    }
+  }
+
+  /*
+   *  Resizes the grid to be `rows` tall and `cols` wide.
+   *  All contents are discarded.
+   */
+  void resize(int rows, int cols) {
+    this->setDimensions(rows, cols);
+
+    std::vector<Cell<T>> newCells;
+
+    for (int y = 0; y < rows; y++) {
+      for (int x = 0; x < cols; x++) {
+        newCells.push_back(Cell<T>(x, y));
+      }
+    }
+
+    m_cells = newCells;
+  }
+
+  /*
+   *  Sets the cell at column `x` and row `y` to `val`.
+   */
+  void setCell(int x, int y, T val) {
+    if (!this->areValid(x, y))
+      throw std::invalid_argument("Out of bounds coordinates.");
+
+    m_cells[y * this->m_cols + x].setData(val);
+  }
+
+  /*
+   *  Returns the i-th cell.
+   */
+  Cell<T> getCell(int i) const {
+    if (i < 0 || i >= this->getSize())
+      throw std::invalid_argument("Out of bounds coordinates.");
+
+    return m_cells[i];
+  }
+
+  /*
+   *  Returns the cell at column `x` and row `y`.
+   */
+  Cell<T> getCell(int x, int y) const {
+    if (!this->areValid(x, y))
+      throw std::invalid_argument("Out of bounds coordinates.");
+
+    return m_cells[y * this->m_cols + x];
+  }
+
+  /*
+   *  Returns a reference to the cell at column `x` and row `y`. Bounds are
+   *  only checked in debug builds.
+   */
+  Cell<T> &cellAt(int x, int y) {
+    assert(this->areValid(x, y));
+    return m_cells[y * this->m_cols + x];
+  }
+  const Cell<T> &cellAt(int x, int y) const {
+    assert(this->areValid(x, y));
+    return m_cells[y * this->m_cols + x];
+  }
+
+  /*
+   *  Returns the cells of row `y`. Bounds are only checked in debug builds.
+   */
+  std::span<Cell<T>> getRow(int y) {
+    assert(y >= 0 && y < this->m_rows);
+    return std::span(m_cells).subspan(y * this->m_cols, this->m_cols);
+  }
+  std::span<const Cell<T>> getRow(int y) const {
+    assert(y >= 0 && y < this->m_rows);
+    return std::span(m_cells).subspan(y * this->m_cols, this->m_cols);
+  }
+
 private:
-  int m_rows;                   // Number of rows
-  int m_cols;                   // Number of columns
   std::vector<Cell<T>> m_cells; // Cells of the grid
 };
 
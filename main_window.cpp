@@ -1,6 +1,6 @@
 #include "main_window.h"
 #include "ui_main_window.h"
-#include <QGraphicsRectItem>
+#include <QFileDialog>
 #include <QStyle>
 #include <iostream>
 
@@ -63,6 +63,8 @@ void MainWindow::setGenGUIParams() {
                                m_gen.getThresholdRange().second);
   m_gui->thresholdSB->setValue(m_gen.getThreshold());
 
+  m_gui->ruleLE->setText(m_gen.getRule());
+
   m_gui->rockRatioSB->setRange(m_gen.getRockRatioRange().first,
                                m_gen.getRockRatioRange().second);
   m_gui->rockRatioSB->setValue(m_gen.getRockRatio());
@@ -75,6 +77,46 @@ void MainWindow::setGenGUIParams() {
                             m_gen.getRadiusRange().second);
   m_gui->radiusSB->setValue(m_gen.getRadius());
 
+  m_gui->threadsSB->setRange(m_gen.getThreadsRange().first,
+                             m_gen.getThreadsRange().second);
+  m_gui->threadsSB->setValue(m_gen.getThreads());
+
+  m_gui->minRegionSB->setRange(m_gen.getMinRegionSizeRange().first,
+                               m_gen.getMinRegionSizeRange().second);
+  m_gui->minRegionSB->setValue(m_gen.getMinRegionSize());
+
+  m_gui->largestRegionCB->setChecked(m_gen.isKeepingLargestRegion());
+
+  m_gui->previewSB->setRange(m_gen.getPreviewIntervalRange().first,
+                             m_gen.getPreviewIntervalRange().second);
+  m_gui->previewSB->setValue(m_gen.getPreviewInterval());
+
+  m_gui->cacheSB->setRange(m_gen.getCacheBudgetRange().first,
+                           m_gen.getCacheBudgetRange().second);
+  m_gui->cacheSB->setValue(m_gen.getCacheBudget());
+
+  m_gui->prefetchSB->setRange(m_gen.getPrefetchCountRange().first,
+                              m_gen.getPrefetchCountRange().second);
+  m_gui->prefetchSB->setValue(m_gen.getPrefetchCount());
+
+  m_gui->cacheDirLE->setText(m_gen.getCacheDirectory());
+
+  m_gui->noiseCB->setCurrentIndex(m_gen.getNoise());
+
+  m_gui->chunkSB->setRange(m_gen.getChunkSizeRange().first,
+                           m_gen.getChunkSizeRange().second);
+  m_gui->chunkSB->setValue(m_gen.getChunkSize());
+
+  m_gui->backendCB->setCurrentIndex(m_gen.getBackend());
+
+  m_gui->noiseScaleSB->setRange(m_gen.getNoiseScaleRange().first,
+                                m_gen.getNoiseScaleRange().second);
+  m_gui->noiseScaleSB->setValue(m_gen.getNoiseScale());
+
+  m_gui->octavesSB->setRange(m_gen.getNoiseOctavesRange().first,
+                             m_gen.getNoiseOctavesRange().second);
+  m_gui->octavesSB->setValue(m_gen.getNoiseOctaves());
+
   m_gui->mooreRad->setChecked(true);
 }
 
@@ -99,6 +141,14 @@ void MainWindow::setSimGUIParams() {
                              m_sim.getPhDecayRange().second);
   m_gui->phDecaySl->setValue(m_sim.getPhDecay());
 
+  m_gui->lazyEvapCB->setChecked(m_sim.isEvaporatingLazily());
+
+  m_gui->depositionCB->setCurrentIndex(m_sim.getDeposition());
+
+  m_gui->fusedStepCB->setChecked(m_sim.isStepFused());
+
+  m_gui->quantizedCB->setChecked(m_sim.isQuantized());
+
   m_gui->speedDial->setValue(5);
 }
 
@@ -111,14 +161,51 @@ void MainWindow::connectSlots() {
   connect(this, &MainWindow::startCaveGeneration, &m_gen,
           &CaveGenerator::generateCave);
 
+  connect(m_gui->saveCaveBtn, &QPushButton::clicked, this,
+          &MainWindow::onSaveCaveRequested);
+
+  connect(this, &MainWindow::saveCaveFile, &m_gen, &CaveGenerator::saveCave);
+
+  connect(m_gui->openCaveBtn, &QPushButton::clicked, this,
+          &MainWindow::onOpenCaveRequested);
+
+  connect(this, &MainWindow::openCaveFile, &m_gen, &CaveGenerator::openCave);
+
   connect(&m_gen, &CaveGenerator::gridReady, this, &MainWindow::onCaveReady);
 
+  connect(&m_gen, &CaveGenerator::caveFileSaved, this,
+          &MainWindow::onCaveFileSaved);
+
+  connect(&m_gen, &CaveGenerator::caveFileOpened, this,
+          &MainWindow::onCaveFileOpened);
+
+  connect(&m_gen, &CaveGenerator::caveFileFailed, this,
+          &MainWindow::onCaveFileFailed);
+
+  connect(&m_gen, &CaveGenerator::stepsPerformed, this,
+          &MainWindow::onCaveStepsPerformed);
+
+  connect(&m_gen, &CaveGenerator::regionsFound, this,
+          &MainWindow::onCaveRegionsFound);
+
+  connect(&m_gen, &CaveGenerator::progressUpdated, this,
+          &MainWindow::onCaveProgress);
+
+  connect(&m_gen, &CaveGenerator::previewReady, this,
+          &MainWindow::onCavePreview);
+
   connect(m_gui->seedSB, &QSpinBox::valueChanged, &m_gen,
           &CaveGenerator::setSeed);
 
   connect(m_gui->thresholdSB, &QSpinBox::valueChanged, &m_gen,
           &CaveGenerator::setThreshold);
 
+  connect(m_gui->ruleLE, &QLineEdit::editingFinished, this,
+          &MainWindow::onCaveRuleEdited);
+
+  connect(this, &MainWindow::caveRuleChanged, &m_gen,
+          &CaveGenerator::setRule);
+
   connect(m_gui->rockRatioSB, &QSpinBox::valueChanged, &m_gen,
           &CaveGenerator::setRockRatio);
 
@@ -128,6 +215,45 @@ void MainWindow::connectSlots() {
   connect(m_gui->radiusSB, &QSpinBox::valueChanged, &m_gen,
           &CaveGenerator::setRadius);
 
+  connect(m_gui->threadsSB, &QSpinBox::valueChanged, &m_gen,
+          &CaveGenerator::setThreads);
+
+  connect(m_gui->minRegionSB, &QSpinBox::valueChanged, &m_gen,
+          &CaveGenerator::setMinRegionSize);
+
+  connect(m_gui->largestRegionCB, &QCheckBox::toggled, &m_gen,
+          &CaveGenerator::setKeepLargestRegion);
+
+  connect(m_gui->previewSB, &QSpinBox::valueChanged, &m_gen,
+          &CaveGenerator::setPreviewInterval);
+
+  connect(m_gui->cacheSB, &QSpinBox::valueChanged, &m_gen,
+          &CaveGenerator::setCacheBudget);
+
+  connect(m_gui->prefetchSB, &QSpinBox::valueChanged, &m_gen,
+          &CaveGenerator::setPrefetchCount);
+
+  connect(m_gui->cacheDirLE, &QLineEdit::editingFinished, this,
+          &MainWindow::onCacheDirEdited);
+
+  connect(this, &MainWindow::cacheDirChanged, &m_gen,
+          &CaveGenerator::setCacheDirectory);
+
+  connect(m_gui->noiseCB, &QComboBox::currentIndexChanged, &m_gen,
+          &CaveGenerator::setNoise);
+
+  connect(m_gui->chunkSB, &QSpinBox::valueChanged, &m_gen,
+          &CaveGenerator::setChunkSize);
+
+  connect(m_gui->backendCB, &QComboBox::currentIndexChanged, &m_gen,
+          &CaveGenerator::setBackend);
+
+  connect(m_gui->noiseScaleSB, &QSpinBox::valueChanged, &m_gen,
+          &CaveGenerator::setNoiseScale);
+
+  connect(m_gui->octavesSB, &QSpinBox::valueChanged, &m_gen,
+          &CaveGenerator::setNoiseOctaves);
+
   connect(m_gui->mooreRad, &QRadioButton::toggled, &m_gen,
           &CaveGenerator::setMooreMode);
 
@@ -153,6 +279,9 @@ void MainWindow::connectSlots() {
 
   connect(&m_sim, &AntSimulator::gridReady, this, &MainWindow::onSimReady);
 
+  connect(&m_sim, &AntSimulator::tilesReady, this,
+          &MainWindow::onSimTilesReady);
+
   connect(&m_sim, &AntSimulator::updateFoodCount, this,
           &MainWindow::onFoodUpdated);
 
@@ -171,6 +300,18 @@ void MainWindow::connectSlots() {
   connect(m_gui->phDecaySl, &QSlider::valueChanged, &m_sim,
           &AntSimulator::setPhDecay);
 
+  connect(m_gui->lazyEvapCB, &QCheckBox::toggled, &m_sim,
+          &AntSimulator::setLazyEvaporation);
+
+  connect(m_gui->depositionCB, &QComboBox::currentIndexChanged, &m_sim,
+          &AntSimulator::setDeposition);
+
+  connect(m_gui->fusedStepCB, &QCheckBox::toggled, &m_sim,
+          &AntSimulator::setFusedStep);
+
+  connect(m_gui->quantizedCB, &QCheckBox::toggled, &m_sim,
+          &AntSimulator::setQuantized);
+
   connect(m_gui->resetSimParamBtn, &QPushButton::clicked, this,
           &MainWindow::resetSimParams);
 
@@ -197,26 +338,48 @@ void MainWindow::connectSlots() {
 }
 
 void MainWindow::drawGrid(Grid<SimCellData> grid) {
-  for (int x = 0; x < grid.getCols(); x++) {
-    for (int y = 0; y < grid.getRows(); y++) {
-      Cell<SimCellData> cell = grid.getCell(x, y);
+  // Each tile is an image, so the simulation only redraws the tiles that
+  // changed
+  TileActivity tiles(grid.getRows(), grid.getCols());
+  m_tileItems.clear();
 
-      // Set the shape of the cell
-      QGraphicsRectItem *item = new QGraphicsRectItem(
-          QRect(x * m_cellSide, y * m_cellSide, m_cellSide, m_cellSide));
+  for (int tile = 0; tile < tiles.getTileCount(); tile++) {
+    TileActivity::Tile bounds = tiles.getTile(tile);
+    QGraphicsPixmapItem *item = new QGraphicsPixmapItem(
+        QPixmap::fromImage(AntSimulator::renderTile(grid, bounds)));
 
-      item->setBrush(QBrush(cell.getData().getColor()));
-      item->setPen(Qt::NoPen); // TODO add checkbox for outline
+    item->setPos(bounds.x0 * m_cellSide, bounds.y0 * m_cellSide);
+    item->setScale(m_cellSide);
 
-      m_scene->addItem(item);
-    }
+    m_scene->addItem(item);
+    m_tileItems.push_back(item);
   }
 
   updateZoom();
 }
 
 void MainWindow::onNewCaveRequested() {
-  emit startCaveGeneration(m_rows, m_cols);
+  // Supersede any cave still being generated
+  emit startCaveGeneration(m_rows, m_cols, m_gen.requestTicket());
+}
+
+void MainWindow::onSaveCaveRequested() {
+  QString path = QFileDialog::getSaveFileName(this, "Save Cave", QString(),
+                                              "Cave files (*.cavt)");
+  if (path.isEmpty())
+    return;
+
+  // Saving also supersedes any cave still being generated
+  emit saveCaveFile(path, m_rows, m_cols, m_gen.requestTicket());
+}
+
+void MainWindow::onOpenCaveRequested() {
+  QString path = QFileDialog::getOpenFileName(this, "Open Cave", QString(),
+                                              "Cave files (*.cavt)");
+  if (path.isEmpty())
+    return;
+
+  emit openCaveFile(path, m_gen.requestTicket());
 }
 
 void MainWindow::onSimInitRequested() { emit initializeSim(); }
@@ -250,19 +413,115 @@ void MainWindow::setSimSpeed(int speed) {
 
 void MainWindow::onCaveReady(Grid<SimCellData> grid) {
   m_timer->stop();
-  m_sim.setup(grid);
+
+  // Setting up replaces the planes and the tiles which running steps use,
+  // so it happens on the simulator's thread. Tiles of the previous grid
+  // still queued are then dropped, as each setup starts a new generation.
+  QMetaObject::invokeMethod(
+      &m_sim, [this, grid] { m_sim.setup(grid); }, Qt::QueuedConnection);
+  m_shownGeneration = ++m_simGeneration;
+
+  // Opened caves can have any size, which the next caves then keep
+  m_rows = grid.getRows();
+  m_cols = grid.getCols();
+  m_scene->setSceneRect(QRect(0, 0, m_cols * m_cellSide, m_rows * m_cellSide));
+
+  m_scene->clear();
+  drawGrid(grid);
+  m_scene->update();
+}
+
+void MainWindow::onCaveProgress(int step, int steps) {
+  m_gui->statusbar->showMessage(
+      QString("Generating cave: step %1 of %2").arg(step).arg(steps));
+}
+
+void MainWindow::onCavePreview(Grid<SimCellData> grid) {
+  // The simulation is about to be replaced, and its tiles would be drawn
+  // over the preview
+  m_timer->stop();
+  m_shownGeneration = -1;
 
   m_scene->clear();
   drawGrid(grid);
   m_scene->update();
 }
 
-void MainWindow::onSimReady(Grid<SimCellData> grid) {
+void MainWindow::onCaveStepsPerformed(int steps) {
+  m_gui->statusbar->showMessage(QString("Cave generated in %1 of %2 steps")
+                                    .arg(steps)
+                                    .arg(m_gui->stepsSB->value()));
+}
+
+void MainWindow::onCaveRegionsFound(std::vector<int> sizes) {
+  QString message = m_gui->statusbar->currentMessage();
+
+  if (sizes.empty())
+    message += ", no floor regions left";
+  else
+    message += QString(", %1 floor regions, largest %2 cells")
+                   .arg(sizes.size())
+                   .arg(sizes.front());
+
+  m_gui->statusbar->showMessage(message);
+}
+
+void MainWindow::onCaveFileSaved(QString path, int steps) {
+  m_gui->statusbar->showMessage(
+      QString("Cave saved to %1, generated in %2 steps").arg(path).arg(steps));
+}
+
+void MainWindow::onCaveFileOpened(QString path, int steps) {
+  m_gui->statusbar->showMessage(
+      QString("Cave opened from %1, generated in %2 steps")
+          .arg(path)
+          .arg(steps));
+}
+
+void MainWindow::onCaveFileFailed(QString path) {
+  m_gui->statusbar->showMessage(
+      QString("Could not access the cave file %1").arg(path));
+}
+
+void MainWindow::onCaveRuleEdited() {
+  QString rule = m_gui->ruleLE->text().trimmed();
+
+  if (!rule.isEmpty() && !CaveRule::parse(rule.toStdString())) {
+    m_gui->statusbar->showMessage(
+        QString("Invalid rule \"%1\", expected e.g. B5678/S45678").arg(rule));
+    return;
+  }
+
+  m_gui->statusbar->clearMessage();
+  emit caveRuleChanged(rule);
+}
+
+void MainWindow::onCacheDirEdited() {
+  emit cacheDirChanged(m_gui->cacheDirLE->text());
+}
+
+void MainWindow::onSimReady(Grid<SimCellData> grid, int generation) {
+  if (generation != m_simGeneration)
+    return;
+
+  m_shownGeneration = generation;
   m_scene->clear();
   drawGrid(grid);
   m_scene->update();
 }
 
+void MainWindow::onSimTilesReady(std::vector<AntSimulator::TileImage> tiles,
+                                 int generation) {
+  if (generation != m_shownGeneration)
+    return;
+
+  for (const AntSimulator::TileImage &tile : tiles) {
+    // Tiles past the grid currently shown are dropped
+    if (tile.tile < static_cast<int>(m_tileItems.size()))
+      m_tileItems[tile.tile]->setPixmap(QPixmap::fromImage(tile.image));
+  }
+}
+
 void MainWindow::onCanvasClick(QPointF coords) {
   int x = floor(coords.x() / m_cellSide);
   int y = floor(coords.y() / m_cellSide);
@@ -285,11 +544,27 @@ void MainWindow::updateZoom() {
 }
 
 void MainWindow::resetGenParams() {
-  m_gen.resetParams();
-  setGenGUIParams();
+  // The generator may be using its cache, so it resets on its own thread
+  // before the widgets pick up the defaults
+  QMetaObject::invokeMethod(
+      &m_gen,
+      [this] {
+        m_gen.resetParams();
+        QMetaObject::invokeMethod(
+            this, [this] { setGenGUIParams(); }, Qt::QueuedConnection);
+      },
+      Qt::QueuedConnection);
 }
 
 void MainWindow::resetSimParams() {
-  m_sim.resetParams();
-  setSimGUIParams();
+  // Resetting reallocates the pheromone planes and the deposit stencil,
+  // which running steps use, so it happens on the simulator's thread
+  QMetaObject::invokeMethod(
+      &m_sim,
+      [this] {
+        m_sim.resetParams();
+        QMetaObject::invokeMethod(
+            this, [this] { setSimGUIParams(); }, Qt::QueuedConnection);
+      },
+      Qt::QueuedConnection);
 }
@@ -4,6 +4,7 @@
 #include "ant_sim.h"
 #include "cave_gen.h"
 #include "custom_graphics_scene.h"
+#include <QGraphicsPixmapItem>
 #include <QGraphicsScene>
 #include <QMainWindow>
 #include <QThread>
@@ -33,6 +34,17 @@ private slots:
    */
   void onNewCaveRequested();
 
+  /*
+   * Ask the cave generator for a new cave saved to a file chosen by the
+   * user.
+   */
+  void onSaveCaveRequested();
+
+  /*
+   * Ask the cave generator for the cave of a file chosen by the user.
+   */
+  void onOpenCaveRequested();
+
   /*
    * Ask the simulator to perform initialization.
    */
@@ -74,9 +86,62 @@ private slots:
   void onCaveReady(Grid<SimCellData> grid);
 
   /*
-   * Draw the simulation grid.
+   * Report the progress of the cave generation.
    */
-  void onSimReady(Grid<SimCellData> grid);
+  void onCaveProgress(int step, int steps);
+
+  /*
+   * Draw a preview of the cave being generated.
+   */
+  void onCavePreview(Grid<SimCellData> grid);
+
+  /*
+   * Report how many steps the cave generation performed.
+   */
+  void onCaveStepsPerformed(int steps);
+
+  /*
+   * Report the floor regions left in the cave.
+   */
+  void onCaveRegionsFound(std::vector<int> sizes);
+
+  /*
+   * Report that a cave file was written.
+   */
+  void onCaveFileSaved(QString path, int steps);
+
+  /*
+   * Report that a cave file was opened.
+   */
+  void onCaveFileOpened(QString path, int steps);
+
+  /*
+   * Report that a cave file could not be written or read.
+   */
+  void onCaveFileFailed(QString path);
+
+  /*
+   * Validate the edited cave rule and pass it to the generator.
+   */
+  void onCaveRuleEdited();
+
+  /*
+   * Pass the edited cave cache directory to the generator.
+   */
+  void onCacheDirEdited();
+
+  /*
+   * Draw the simulation grid, unless it is of an older generation than the
+   * grid last set up.
+   */
+  void onSimReady(Grid<SimCellData> grid, int generation);
+
+  /*
+   * Draw the simulation tiles that changed, unless they are of another
+   * generation than the grid drawn.
+   */
+  void onSimTilesReady(std::vector<AntSimulator::TileImage> tiles,
+                       int generation);
 
   /*
    * Pass the clicked cell coordinates to the simulator.
@@ -107,7 +172,27 @@ signals:
   /*
    * Emitted when a new cave is requested.
    */
-  void startCaveGeneration(int rows, int cols);
+  void startCaveGeneration(int rows, int cols, int ticket);
+
+  /*
+   * Emitted when a new cave is requested into a file.
+   */
+  void saveCaveFile(QString path, int rows, int cols, int ticket);
+
+  /*
+   * Emitted when the cave of a file is requested.
+   */
+  void openCaveFile(QString path, int ticket);
+
+  /*
+   * Emitted when a valid cave rule is entered.
+   */
+  void caveRuleChanged(QString rule);
+
+  /*
+   * Emitted when a cave cache directory is entered.
+   */
+  void cacheDirChanged(QString directory);
 
   /*
    * Emitted when the initialization of the simulator is requested.
@@ -136,6 +221,10 @@ private:
   int m_cellSide = 1;           // Width of grid cells, in pixels
   QThread m_genWorker;          // Cave generation thread
   QThread m_simWorker;          // Population simulation thread
+  int m_simGeneration = 0;      // Grids set up in the simulator
+  int m_shownGeneration = 0;    // Simulator grid drawn, -1 for a preview
+
+  std::vector<QGraphicsPixmapItem *> m_tileItems; // Items drawing each tile
 
   /*
    * Connect the GUI items' signals to the relative slots.
@@ -0,0 +1,34 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+/*
+ * Splits [begin, end) into at most `threads` contiguous chunks of similar
+ * size and calls `f(chunkBegin, chunkEnd)` for each of them, each on its own
+ * thread. The first chunk runs on the calling thread. Returns once all
+ * chunks are done.
+ */
+template <typename F>
+void parallelRanges(int begin, int end, int threads, F &&f) {
+  int count = end - begin;
+  threads = std::clamp(threads, 1, std::max(count, 1));
+
+  std::vector<std::jthread> workers;
+  workers.reserve(threads - 1);
+
+  for (int t = 1; t < threads; t++) {
+    int chunkBegin = begin + static_cast<int>(static_cast<long long>(count) *
+                                              t / threads);
+    int chunkEnd = begin + static_cast<int>(static_cast<long long>(count) *
+                                            (t + 1) / threads);
+    workers.emplace_back(
+        [&f, chunkBegin, chunkEnd] { f(chunkBegin, chunkEnd); });
+  }
+
+  f(begin, begin + count / threads);
+}
+
+#endif // PARALLEL_H
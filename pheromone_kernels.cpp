@@ -0,0 +1,184 @@
+#include "pheromone_kernels.h"
+#include <algorithm>
+#include <cassert>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+bool evaporatePheromones(std::span<float> home, std::span<float> food,
+                         float rate) {
+  assert(home.size() == food.size());
+  size_t count = home.size();
+  size_t i = 0;
+  bool anyLeft = false;
+
+#ifdef __SSE2__
+  // The maximum is taken with 0 first so that it returns the same results as
+  // std::max, down to the sign of zeros
+  __m128 rates = _mm_set1_ps(rate);
+  __m128 zeros = _mm_setzero_ps();
+  __m128 left = zeros;
+  for (; i + 4 <= count; i += 4) {
+    __m128 homeLevels = _mm_sub_ps(_mm_loadu_ps(&home[i]), rates);
+    __m128 foodLevels = _mm_sub_ps(_mm_loadu_ps(&food[i]), rates);
+    homeLevels = _mm_max_ps(zeros, homeLevels);
+    foodLevels = _mm_max_ps(zeros, foodLevels);
+    _mm_storeu_ps(&home[i], homeLevels);
+    _mm_storeu_ps(&food[i], foodLevels);
+    left = _mm_or_ps(left, _mm_cmpgt_ps(_mm_add_ps(homeLevels, foodLevels),
+                                        zeros));
+  }
+  anyLeft = _mm_movemask_ps(left) != 0;
+#endif
+
+  for (; i < count; i++) {
+    home[i] = std::max(home[i] - rate, 0.0f);
+    food[i] = std::max(food[i] - rate, 0.0f);
+    anyLeft |= home[i] > 0.0f || food[i] > 0.0f;
+  }
+
+  return anyLeft;
+}
+
+bool evaporatePheromones(std::span<uint16_t> home, std::span<uint16_t> food,
+                         uint16_t rate) {
+  assert(home.size() == food.size());
+  size_t count = home.size();
+  size_t i = 0;
+  uint16_t left = 0;
+
+#ifdef __SSE2__
+  __m128i rates = _mm_set1_epi16(static_cast<int16_t>(rate));
+  __m128i lefts = _mm_setzero_si128();
+  for (; i + 8 <= count; i += 8) {
+    __m128i *homeLevels = reinterpret_cast<__m128i *>(&home[i]);
+    __m128i *foodLevels = reinterpret_cast<__m128i *>(&food[i]);
+    __m128i homeLeft = _mm_subs_epu16(_mm_loadu_si128(homeLevels), rates);
+    __m128i foodLeft = _mm_subs_epu16(_mm_loadu_si128(foodLevels), rates);
+    _mm_storeu_si128(homeLevels, homeLeft);
+    _mm_storeu_si128(foodLevels, foodLeft);
+    lefts = _mm_or_si128(lefts, _mm_or_si128(homeLeft, foodLeft));
+  }
+  if (_mm_movemask_epi8(_mm_cmpeq_epi16(lefts, _mm_setzero_si128())) != 0xFFFF)
+    left = 1;
+#endif
+
+  for (; i < count; i++) {
+    home[i] = std::max(home[i] - rate, 0);
+    food[i] = std::max(food[i] - rate, 0);
+    left |= home[i] | food[i];
+  }
+
+  return left != 0;
+}
+
+DepositStencil::DepositStencil(float strength, int maxSourceDist,
+                               int maxTraveled)
+    : m_strength(strength), m_stride(maxSourceDist + 1),
+      m_maxTraveled(maxTraveled) {
+  m_weights.resize(static_cast<size_t>(m_stride) * (maxTraveled + 1));
+
+  for (int traveled = 0; traveled <= maxTraveled; traveled++) {
+    for (int dist = 0; dist < m_stride; dist++)
+      m_weights[traveled * m_stride + dist] =
+          SimCellData::depositWeight(strength, dist, traveled);
+  }
+}
+
+bool catchUpPheromones(std::span<float> home, std::span<float> food,
+                       std::span<const uint32_t> ticks, uint32_t tick,
+                       float rate) {
+  assert(home.size() == food.size() && home.size() == ticks.size());
+  size_t count = home.size();
+  size_t i = 0;
+  bool anyLeft = false;
+
+  // Elapsed ticks are converted as signed integers, which SSE2 supports and
+  // which hold any realistic number of steps
+#ifdef __SSE2__
+  __m128 rates = _mm_set1_ps(rate);
+  __m128i ticksNow = _mm_set1_epi32(static_cast<int32_t>(tick));
+  __m128 zeros = _mm_setzero_ps();
+  __m128 left = zeros;
+  for (; i + 4 <= count; i += 4) {
+    __m128i stamps =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(&ticks[i]));
+    __m128i elapsed = _mm_sub_epi32(ticksNow, stamps);
+    __m128 decays = _mm_mul_ps(rates, _mm_cvtepi32_ps(elapsed));
+    __m128 homeLevels = _mm_sub_ps(_mm_loadu_ps(&home[i]), decays);
+    __m128 foodLevels = _mm_sub_ps(_mm_loadu_ps(&food[i]), decays);
+    homeLevels = _mm_max_ps(zeros, homeLevels);
+    foodLevels = _mm_max_ps(zeros, foodLevels);
+    _mm_storeu_ps(&home[i], homeLevels);
+    _mm_storeu_ps(&food[i], foodLevels);
+    left = _mm_or_ps(left, _mm_cmpgt_ps(_mm_add_ps(homeLevels, foodLevels),
+                                        zeros));
+  }
+  anyLeft = _mm_movemask_ps(left) != 0;
+#endif
+
+  for (; i < count; i++) {
+    float decay = rate * static_cast<int32_t>(tick - ticks[i]);
+    home[i] = std::max(home[i] - decay, 0.0f);
+    food[i] = std::max(food[i] - decay, 0.0f);
+    anyLeft |= home[i] > 0.0f || food[i] > 0.0f;
+  }
+
+  return anyLeft;
+}
+
+bool catchUpPheromones(std::span<uint16_t> home, std::span<uint16_t> food,
+                       std::span<const uint32_t> ticks, uint32_t tick,
+                       uint16_t rate) {
+  assert(home.size() == food.size() && home.size() == ticks.size());
+  size_t count = home.size();
+  size_t i = 0;
+  uint16_t left = 0;
+
+  // Elapsed ticks are narrowed with unsigned saturation, by offsetting them
+  // around the signed saturation SSE2 supports, and the decays saturate
+  // wherever the high half of their product is set
+#ifdef __SSE2__
+  __m128i rates = _mm_set1_epi16(static_cast<int16_t>(rate));
+  __m128i ticksNow = _mm_set1_epi32(static_cast<int32_t>(tick));
+  __m128i offsets = _mm_set1_epi32(0x8000);
+  __m128i signs = _mm_set1_epi16(static_cast<int16_t>(0x8000));
+  __m128i zeros = _mm_setzero_si128();
+  __m128i ones = _mm_cmpeq_epi16(zeros, zeros);
+  __m128i lefts = zeros;
+  for (; i + 8 <= count; i += 8) {
+    const __m128i *stamps = reinterpret_cast<const __m128i *>(&ticks[i]);
+    __m128i low = _mm_sub_epi32(ticksNow, _mm_loadu_si128(stamps));
+    __m128i high = _mm_sub_epi32(ticksNow, _mm_loadu_si128(stamps + 1));
+    __m128i elapsed = _mm_xor_si128(
+        _mm_packs_epi32(_mm_sub_epi32(low, offsets),
+                        _mm_sub_epi32(high, offsets)),
+        signs);
+    __m128i fits = _mm_cmpeq_epi16(_mm_mulhi_epu16(elapsed, rates), zeros);
+    __m128i decays = _mm_or_si128(_mm_mullo_epi16(elapsed, rates),
+                                  _mm_andnot_si128(fits, ones));
+
+    __m128i *homeLevels = reinterpret_cast<__m128i *>(&home[i]);
+    __m128i *foodLevels = reinterpret_cast<__m128i *>(&food[i]);
+    __m128i homeLeft = _mm_subs_epu16(_mm_loadu_si128(homeLevels), decays);
+    __m128i foodLeft = _mm_subs_epu16(_mm_loadu_si128(foodLevels), decays);
+    _mm_storeu_si128(homeLevels, homeLeft);
+    _mm_storeu_si128(foodLevels, foodLeft);
+    lefts = _mm_or_si128(lefts, _mm_or_si128(homeLeft, foodLeft));
+  }
+  if (_mm_movemask_epi8(_mm_cmpeq_epi16(lefts, zeros)) != 0xFFFF)
+    left = 1;
+#endif
+
+  for (; i < count; i++) {
+    uint32_t elapsed = std::min<uint32_t>(
+        static_cast<int32_t>(tick - ticks[i]), UINT16_MAX);
+    int decay = std::min<uint32_t>(elapsed * rate, UINT16_MAX);
+    home[i] = std::max(home[i] - decay, 0);
+    food[i] = std::max(food[i] - decay, 0);
+    left |= home[i] | food[i];
+  }
+
+  return left != 0;
+}
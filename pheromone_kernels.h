@@ -0,0 +1,80 @@
+#ifndef PHEROMONE_KERNELS_H
+#define PHEROMONE_KERNELS_H
+
+#include "sim_cell_data.h"
+#include <cassert>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/*
+ * Simulates the evaporation of the pheromone levels in `home` and `food`,
+ * lowering each by `rate` without going below 0, like
+ * SimCellData::decrementPheromones. Both planes are walked contiguously in a
+ * single pass, four levels at a time where SSE2 is available. Returns true if
+ * any level is left above 0.
+ */
+bool evaporatePheromones(std::span<float> home, std::span<float> food,
+                         float rate);
+
+/*
+ * Same as above for fixed-point levels, with saturating subtractions eight
+ * levels at a time where SSE2 is available.
+ */
+bool evaporatePheromones(std::span<uint16_t> home, std::span<uint16_t> food,
+                         uint16_t rate);
+
+/*
+ * Brings the pheromone levels in `home` and `food` up to tick `tick`, where
+ * `ticks` holds the tick each level was last updated at. Each level is
+ * lowered by `rate` per elapsed tick without going below 0. Returns true if
+ * any level is left above 0.
+ */
+bool catchUpPheromones(std::span<float> home, std::span<float> food,
+                       std::span<const uint32_t> ticks, uint32_t tick,
+                       float rate);
+
+/*
+ * Same as above for fixed-point levels.
+ */
+bool catchUpPheromones(std::span<uint16_t> home, std::span<uint16_t> food,
+                       std::span<const uint32_t> ticks, uint32_t tick,
+                       uint16_t rate);
+
+/*
+ * Table of the pheromone deposit weights of SimCellData::depositWeight for a
+ * given strength, indexed by the distance from the source and the distance
+ * traveled by the emitter ant, so that deposits need no powf or sqrtf.
+ */
+class DepositStencil {
+
+public:
+  /*
+   *  Creates the table for strength `strength`, distances from the source
+   *  up to `maxSourceDist` and traveled distances up to `maxTraveled`.
+   */
+  DepositStencil(float strength = 0.0f, int maxSourceDist = 0,
+                 int maxTraveled = 0);
+
+  /*
+   *  Returns the weight of a deposit `sourceDist` cells away from the source
+   *  by an ant that traveled `traveledDistance` cells. Traveled distances
+   *  past the table are computed instead.
+   */
+  float getWeight(int sourceDist, int traveledDistance) const {
+    assert(sourceDist >= 0 && sourceDist < m_stride && traveledDistance >= 0);
+    if (traveledDistance > m_maxTraveled)
+      return SimCellData::depositWeight(m_strength, sourceDist,
+                                        traveledDistance);
+
+    return m_weights[traveledDistance * m_stride + sourceDist];
+  }
+
+private:
+  float m_strength;             // Strength of the deposits
+  int m_stride;                 // Number of distances from the source
+  int m_maxTraveled;            // Largest traveled distance in the table
+  std::vector<float> m_weights; // Weights, one row per traveled distance
+};
+
+#endif // PHEROMONE_KERNELS_H
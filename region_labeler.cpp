@@ -0,0 +1,213 @@
+#include "region_labeler.h"
+#include "parallel.h"
+#include "sim_cell_data.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+/*
+ * Returns the first column in [x, cols) of `row` whose cell is floor if
+ * `floor` is false, or not floor if `floor` is true, or `cols` if there is
+ * none. Cells are tested eight at a time as the bytes of a word.
+ */
+int skipCells(const uint8_t *row, int x, int cols, bool floor) {
+  static_assert(SimCellData::FLOOR == 0);
+  const uint64_t ones = 0x0101010101010101;
+  const uint64_t highs = 0x8080808080808080;
+
+  for (; x + 8 <= cols; x += 8) {
+    uint64_t word;
+    std::memcpy(&word, row + x, 8);
+
+    // High bits of the bytes which end the skipped cells
+    uint64_t stops = floor ? ((word | ((word & ~highs) + ~highs)) & highs)
+                           : ((word - ones) & ~word & highs);
+    if (stops != 0)
+      return x + std::countr_zero(stops) / 8;
+  }
+
+  for (; x < cols; x++) {
+    if ((row[x] == SimCellData::FLOOR) != floor)
+      return x;
+  }
+
+  return cols;
+}
+
+/*
+ * Returns the root of the tree containing the i-th element of the
+ * union-find forest `parent`.
+ */
+int find(std::span<const int> parent, int i) {
+  while (parent[i] != i)
+    i = parent[i];
+
+  return i;
+}
+
+/*
+ * Merges the trees containing the i-th and j-th elements of the union-find
+ * forest `parent`, using Rem's algorithm. Trees are linked towards the
+ * smaller parent while splicing the paths, which keeps every parent before
+ * its children.
+ */
+void unite(std::span<int> parent, int i, int j) {
+  while (parent[i] != parent[j]) {
+    if (parent[i] < parent[j])
+      std::swap(i, j);
+
+    if (parent[i] == i) {
+      parent[i] = parent[j];
+      return;
+    }
+
+    int next = parent[i];
+    parent[i] = parent[j];
+    i = next;
+  }
+}
+
+/*
+ * Joins the runs [above, begin) of a row with the runs [begin, end) of the
+ * next row touching them, including diagonally, in the union-find forest
+ * `parent`.
+ */
+void joinRows(std::span<const RegionLabeler::Run> runs, std::span<int> parent,
+              int above, int begin, int end) {
+  int aboveEnd = begin;
+  int run = begin;
+
+  // Walk both rows together, runs touch if they overlap once widened by one
+  while (above < aboveEnd && run < end) {
+    if (runs[run].x0 <= runs[above].x1 && runs[above].x0 <= runs[run].x1)
+      unite(parent, run, above);
+
+    if (runs[run].x1 < runs[above].x1)
+      run++;
+    else
+      above++;
+  }
+}
+
+} // namespace
+
+void RegionLabeler::label(std::span<const uint8_t> types, int rows, int cols,
+                          int threads) {
+  if (types.size() != static_cast<size_t>(rows) * cols)
+    throw std::invalid_argument("Mismatched grid dimensions.");
+
+  int strips = std::clamp(threads, 1, std::max(rows, 1));
+  auto stripBegin = [&](int strip) {
+    return static_cast<int>(static_cast<long long>(rows) * strip / strips);
+  };
+
+  // Runs of floor cells within `row`, passed to `f(x0, x1)` in order
+  auto forEachRun = [&](const uint8_t *row, auto &&f) {
+    for (int x = skipCells(row, 0, cols, false); x < cols;) {
+      int x0 = x;
+      x = skipCells(row, x, cols, true);
+      f(x0, x);
+      x = skipCells(row, x, cols, false);
+    }
+  };
+
+  // Label each strip on its own, only joining rows within the strip. Runs
+  // are numbered from the start of their strip until the strips are merged.
+  std::vector<std::vector<Run>> stripRuns(strips);
+  std::vector<std::vector<int>> stripParents(strips);
+  m_firstRuns.resize(rows + 1);
+
+  parallelRanges(0, strips, threads, [&](int begin, int end) {
+    for (int strip = begin; strip < end; strip++) {
+      std::vector<Run> &runs = stripRuns[strip];
+      std::vector<int> &parent = stripParents[strip];
+
+      for (int y = stripBegin(strip); y < stripBegin(strip + 1); y++) {
+        m_firstRuns[y] = runs.size();
+        forEachRun(types.data() + static_cast<size_t>(y) * cols,
+                   [&](int x0, int x1) {
+                     parent.push_back(runs.size());
+                     runs.push_back({y, x0, x1});
+                   });
+
+        if (y > stripBegin(strip))
+          joinRows(runs, parent, m_firstRuns[y - 1], m_firstRuns[y],
+                   runs.size());
+      }
+    }
+  });
+
+  std::vector<int> firstStripRuns(strips + 1, 0);
+  for (int strip = 0; strip < strips; strip++) {
+    firstStripRuns[strip + 1] =
+        firstStripRuns[strip] + static_cast<int>(stripRuns[strip].size());
+  }
+
+  int runCount = firstStripRuns[strips];
+  m_runs.resize(runCount);
+  m_parent.resize(runCount);
+  m_labels.resize(runCount);
+  m_firstRuns[rows] = runCount;
+
+  parallelRanges(0, strips, threads, [&](int begin, int end) {
+    for (int strip = begin; strip < end; strip++) {
+      int offset = firstStripRuns[strip];
+      std::ranges::copy(stripRuns[strip], m_runs.begin() + offset);
+      for (size_t run = 0; run < stripParents[strip].size(); run++)
+        m_parent[offset + run] = stripParents[strip][run] + offset;
+      for (int y = stripBegin(strip); y < stripBegin(strip + 1); y++)
+        m_firstRuns[y] += offset;
+    }
+  });
+
+  // Join the strips along their boundaries
+  for (int strip = 1; strip < strips; strip++) {
+    int y = stripBegin(strip);
+    joinRows(m_runs, m_parent, m_firstRuns[y - 1], m_firstRuns[y],
+             m_firstRuns[y + 1]);
+  }
+
+  // Resolve the roots and count the regions rooted in each strip
+  std::vector<int> firstLabels(strips + 1, 0);
+
+  parallelRanges(0, strips, threads, [&](int begin, int end) {
+    for (int strip = begin; strip < end; strip++) {
+      int roots = 0;
+      for (int run = firstStripRuns[strip]; run < firstStripRuns[strip + 1];
+           run++) {
+        m_labels[run] = find(m_parent, run);
+        roots += m_labels[run] == run;
+      }
+
+      firstLabels[strip + 1] = roots;
+    }
+  });
+
+  for (int strip = 0; strip < strips; strip++)
+    firstLabels[strip + 1] += firstLabels[strip];
+
+  // Number the roots, which are no longer needed as parents
+  parallelRanges(0, strips, threads, [&](int begin, int end) {
+    for (int strip = begin; strip < end; strip++) {
+      int next = firstLabels[strip];
+      for (int run = firstStripRuns[strip]; run < firstStripRuns[strip + 1];
+           run++) {
+        if (m_labels[run] == run)
+          m_parent[run] = next++;
+      }
+    }
+  });
+
+  parallelRanges(0, runCount, threads, [&](int begin, int end) {
+    for (int run = begin; run < end; run++)
+      m_labels[run] = m_parent[m_labels[run]];
+  });
+
+  m_sizes.assign(firstLabels[strips], 0);
+  for (int run = 0; run < runCount; run++)
+    m_sizes[m_labels[run]] += m_runs[run].x1 - m_runs[run].x0;
+}
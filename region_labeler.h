@@ -0,0 +1,67 @@
+#ifndef REGION_LABELER_H
+#define REGION_LABELER_H
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/*
+ * Labels the connected floor regions of a grid. Floor cells are connected
+ * to their eight neighbours, the same cells an ant can step to.
+ *
+ * Each row is broken into runs of consecutive floor cells, which are joined
+ * with the overlapping runs of the previous row in a union-find forest.
+ * Rows are split into strips labeled in parallel, then the strips are joined
+ * along their boundaries and the forest is flattened into region labels.
+ */
+class RegionLabeler {
+
+public:
+  /*
+   * A run of floor cells spanning columns [x0, x1) of row y.
+   */
+  struct Run {
+    int y;
+    int x0;
+    int x1;
+  };
+
+  /*
+   *  Labels the floor regions of the row-major cell types in `types`, which
+   *  describe a grid with `rows` rows and `cols` columns, using up to
+   *  `threads` threads.
+   */
+  void label(std::span<const uint8_t> types, int rows, int cols,
+             int threads = 1);
+
+  /*
+   *  Returns the runs of floor cells, ordered by row and column.
+   */
+  std::span<const Run> getRuns() const { return m_runs; }
+
+  /*
+   *  Returns the region label of each run, a number in
+   *  [0, getRegionCount()). Regions are numbered in the order of their first
+   *  cell.
+   */
+  std::span<const int> getRunLabels() const { return m_labels; }
+
+  /*
+   *  Returns the number of cells of each region, indexed by label.
+   */
+  const std::vector<int> &getSizes() const { return m_sizes; }
+
+  /*
+   *  Returns the number of regions.
+   */
+  int getRegionCount() const { return static_cast<int>(m_sizes.size()); }
+
+private:
+  std::vector<Run> m_runs;      // Runs of floor cells
+  std::vector<int> m_firstRuns; // Index of the first run of each row
+  std::vector<int> m_parent;    // Union-find forest over the runs
+  std::vector<int> m_labels;    // Region label of each run
+  std::vector<int> m_sizes;     // Number of cells of each region
+};
+
+#endif // REGION_LABELER_H
@@ -0,0 +1,161 @@
+#include "rock_tables.h"
+#include "parallel.h"
+#include "sim_cell_data.h"
+#include <algorithm>
+#include <stdexcept>
+
+void SummedAreaTable::build(std::span<const uint8_t> types, int rows,
+                            int cols, int threads) {
+  if (types.size() != static_cast<size_t>(rows) * cols)
+    throw std::invalid_argument("Mismatched grid dimensions.");
+
+  m_rows = rows;
+  m_cols = cols;
+  m_sums.assign(static_cast<size_t>(rows + 1) * (cols + 1), 0);
+
+  auto sumsRow = [&](int y) {
+    return m_sums.data() + static_cast<size_t>(y) * (cols + 1);
+  };
+
+  // Prefix sums along each row, which are independent of each other
+  parallelRanges(0, rows, threads, [&](int rowBegin, int rowEnd) {
+    for (int y = rowBegin; y < rowEnd; y++) {
+      const uint8_t *row = types.data() + static_cast<size_t>(y) * cols;
+      int *sums = sumsRow(y + 1);
+
+      int rowSum = 0;
+      for (int x = 0; x < cols; x++) {
+        rowSum += row[x] == SimCellData::ROCK;
+        sums[x + 1] = rowSum;
+      }
+    }
+  });
+
+  // Accumulate down each column, splitting the columns among the threads
+  parallelRanges(1, cols + 1, threads, [&](int colBegin, int colEnd) {
+    for (int y = 1; y <= rows; y++) {
+      const int *above = sumsRow(y - 1);
+      int *sums = sumsRow(y);
+
+      for (int x = colBegin; x < colEnd; x++)
+        sums[x] += above[x];
+    }
+  });
+}
+
+int SummedAreaTable::count(int x0, int y0, int x1, int y1) const {
+  x0 = std::max(x0, 0);
+  y0 = std::max(y0, 0);
+  x1 = std::min(x1, m_cols - 1);
+  y1 = std::min(y1, m_rows - 1);
+
+  if (x0 > x1 || y0 > y1)
+    return 0;
+
+  auto at = [&](int x, int y) {
+    return m_sums[static_cast<size_t>(y) * (m_cols + 1) + x];
+  };
+
+  return at(x1 + 1, y1 + 1) - at(x0, y1 + 1) - at(x1 + 1, y0) + at(x0, y0);
+}
+
+void DiamondSumTable::build(std::span<const uint8_t> types, int rows,
+                            int cols) {
+  if (types.size() != static_cast<size_t>(rows) * cols)
+    throw std::invalid_argument("Mismatched grid dimensions.");
+
+  m_rows = rows;
+  m_cols = cols;
+  m_rowSums.assign(rows + 1, 0);
+  m_diagonal.assign(static_cast<size_t>(rows) * (cols + 1), 0);
+  m_antiDiagonal.assign(static_cast<size_t>(rows) * (cols + 1), 0);
+
+  for (int y = 0; y < rows; y++) {
+    const uint8_t *row = types.data() + static_cast<size_t>(y) * cols;
+    int *diagonal = m_diagonal.data() + static_cast<size_t>(y) * (cols + 1);
+    int *antiDiagonal =
+        m_antiDiagonal.data() + static_cast<size_t>(y) * (cols + 1);
+    const int *prevDiagonal = diagonal - (cols + 1);
+    const int *prevAntiDiagonal = antiDiagonal - (cols + 1);
+
+    // P(y, c) is accumulated on the fly
+    int prefix = 0;
+    for (int c = 0; c <= cols; c++) {
+      if (y == 0) {
+        diagonal[c] = prefix;
+        antiDiagonal[c] = prefix;
+      } else {
+        diagonal[c] = prefix + (c > 0 ? prevDiagonal[c - 1] : 0);
+        antiDiagonal[c] =
+            prefix + (c < cols ? prevAntiDiagonal[c + 1] : m_rowSums[y]);
+      }
+
+      if (c < cols)
+        prefix += row[c] == SimCellData::ROCK;
+    }
+
+    m_rowSums[y + 1] = m_rowSums[y] + prefix;
+  }
+}
+
+int DiamondSumTable::rowsUpTo(int y) const {
+  return m_rowSums[std::clamp(y + 1, 0, m_rows)];
+}
+
+int DiamondSumTable::diagonal(int c, int y) const {
+  // Rows past the bottom of the grid are empty
+  if (y >= m_rows) {
+    c -= y - m_rows + 1;
+    y = m_rows - 1;
+  }
+
+  if (y < 0 || c <= 0)
+    return 0;
+
+  // Past the right edge P(y, c) is the whole row
+  if (c > m_cols) {
+    int excess = c - m_cols;
+    return rowsUpTo(y) - rowsUpTo(y - excess) + diagonal(m_cols, y - excess);
+  }
+
+  return m_diagonal[static_cast<size_t>(y) * (m_cols + 1) + c];
+}
+
+int DiamondSumTable::antiDiagonal(int c, int y) const {
+  // Rows past the bottom of the grid are empty
+  if (y >= m_rows) {
+    c += y - m_rows + 1;
+    y = m_rows - 1;
+  }
+
+  // Before the left edge P(y, c) is zero
+  if (c < 0) {
+    y += c;
+    c = 0;
+  }
+
+  if (y < 0)
+    return 0;
+
+  // Past the right edge P(y, c) is the whole row
+  if (c >= m_cols)
+    return rowsUpTo(y);
+
+  return m_antiDiagonal[static_cast<size_t>(y) * (m_cols + 1) + c];
+}
+
+int DiamondSumTable::count(int x, int y, int radius) const {
+  if (radius < 0)
+    return 0;
+
+  // Each row of the diamond is P(y + dy, right + 1) - P(y + dy, left), and
+  // the right and left ends trace the four diagonal edges
+  int upperRight = diagonal(x + radius + 1, y) - diagonal(x, y - radius - 1);
+  int upperLeft =
+      antiDiagonal(x - radius, y) - antiDiagonal(x + 1, y - radius - 1);
+  int lowerRight =
+      antiDiagonal(x + 1, y + radius) - antiDiagonal(x + radius + 1, y);
+  int lowerLeft = diagonal(x, y + radius) - diagonal(x - radius, y);
+
+  return upperRight - upperLeft + lowerRight - lowerLeft;
+}
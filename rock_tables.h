@@ -0,0 +1,82 @@
+#ifndef ROCK_TABLES_H
+#define ROCK_TABLES_H
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/*
+ * Summed-area table over the rocks of a grid, answering rock counts in
+ * rectangles in constant time.
+ */
+class SummedAreaTable {
+
+public:
+  /*
+   *  Builds the table for the row-major cell types in `types`, which describe
+   *  a grid with `rows` rows and `cols` columns, using up to `threads`
+   *  threads.
+   */
+  void build(std::span<const uint8_t> types, int rows, int cols,
+             int threads = 1);
+
+  /*
+   *  Returns the number of rocks in the rectangle spanning columns [x0, x1]
+   *  and rows [y0, y1]. Cells outside the grid are not counted.
+   */
+  int count(int x0, int y0, int x1, int y1) const;
+
+private:
+  int m_rows = 0;          // Number of rows
+  int m_cols = 0;          // Number of columns
+  std::vector<int> m_sums; // Rocks above and to the left of each corner
+};
+
+/*
+ * Diagonal prefix sums over the rocks of a grid, answering rock counts in
+ * diamonds (Von Neumann neighbourhoods) in constant time.
+ *
+ * With P(y, c) denoting the rocks in row y before column c, the tables hold
+ * the sums of P along the two diagonal directions. Each edge of a diamond is
+ * a difference of two such sums.
+ */
+class DiamondSumTable {
+
+public:
+  /*
+   *  Builds the table for the row-major cell types in `types`, which describe
+   *  a grid with `rows` rows and `cols` columns.
+   */
+  void build(std::span<const uint8_t> types, int rows, int cols);
+
+  /*
+   *  Returns the number of rocks within Manhattan distance `radius` of the
+   *  cell at column `x` and row `y`, including the cell itself. Cells outside
+   *  the grid are not counted.
+   */
+  int count(int x, int y, int radius) const;
+
+private:
+  int m_rows = 0;                  // Number of rows
+  int m_cols = 0;                  // Number of columns
+  std::vector<int> m_rowSums;      // Rocks in the rows before each row
+  std::vector<int> m_diagonal;     // Sums of P(y - k, c - k) for k >= 0
+  std::vector<int> m_antiDiagonal; // Sums of P(y - k, c + k) for k >= 0
+
+  /*
+   *  Returns the number of rocks in rows [0, y].
+   */
+  int rowsUpTo(int y) const;
+
+  /*
+   *  Returns the sum of P(y - k, c - k) for k >= 0, for any c and y.
+   */
+  int diagonal(int c, int y) const;
+
+  /*
+   *  Returns the sum of P(y - k, c + k) for k >= 0, for any c and y.
+   */
+  int antiDiagonal(int c, int y) const;
+};
+
+#endif // ROCK_TABLES_H
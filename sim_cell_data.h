@@ -22,6 +22,13 @@ public:
    */
   SimCellData(Type type = Type::FLOOR) : m_type(type) {}
 
+  /*
+   * Constructs a data object with the specified type and pheromone levels.
+   */
+  SimCellData(Type type, float homePheromone, float foodPheromone)
+      : m_type(type), m_homePheromone(homePheromone),
+        m_foodPheromone(foodPheromone) {}
+
   /*
    * Sets the type of the cell.
    */
@@ -33,13 +40,8 @@ public:
    */
   void incrementHomePheromone(float strength, float sourceDist,
                               float traveledDistance) {
-    if (sourceDist < 0 || traveledDistance < 0)
-      return;
-
-    m_homePheromone =
-        std::min(m_homePheromone + strength / (powf(sourceDist + 1.0f, 2) *
-                                               sqrtf(traveledDistance + 1.0f)),
-                 1.0f);
+    m_homePheromone = depositPheromone(m_homePheromone, strength, sourceDist,
+                                       traveledDistance);
   }
 
   /*
@@ -48,13 +50,31 @@ public:
    */
   void incrementFoodPheromone(float strength, float sourceDist,
                               float traveledDistance) {
+    m_foodPheromone = depositPheromone(m_foodPheromone, strength, sourceDist,
+                                       traveledDistance);
+  }
+
+  /*
+   * Returns the pheromone signal `level` after a deposit based on the distance
+   * from the source and the distance traveled by the emitter ant.
+   */
+  static float depositPheromone(float level, float strength, float sourceDist,
+                                float traveledDistance) {
     if (sourceDist < 0 || traveledDistance < 0)
-      return;
+      return level;
+
+    return std::min(
+        level + depositWeight(strength, sourceDist, traveledDistance), 1.0f);
+  }
 
-    m_foodPheromone =
-        std::min(m_foodPheromone + strength / (powf(sourceDist + 1.0f, 2) *
-                                               sqrtf(traveledDistance + 1.0f)),
-                 1.0f);
+  /*
+   * Returns the amount of pheromone added by a deposit based on the distance
+   * from the source and the distance traveled by the emitter ant.
+   */
+  static float depositWeight(float strength, float sourceDist,
+                             float traveledDistance) {
+    return strength /
+           (powf(sourceDist + 1.0f, 2) * sqrtf(traveledDistance + 1.0f));
   }
 
   /*
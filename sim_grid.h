@@ -0,0 +1,411 @@
+#ifndef SIM_GRID_H
+#define SIM_GRID_H
+
+#include "grid.h"
+#include "sim_cell_data.h"
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <span>
+
+/*
+ * Grid of simulation cells stored as separate planes: one byte per cell for
+ * its type and one float per cell for each pheromone. Coordinates are derived
+ * from the cell index instead of being stored, so whole-grid passes only
+ * stream the plane they work on. Pheromones can instead be stored as 16-bit
+ * fixed-point levels, which halves their planes.
+ *
+ * The planes can also hold a halo of rock cells without pheromones around
+ * the grid, so that small neighbourhoods can be indexed with fixed offsets
+ * from any cell without bounds checks.
+ */
+template <>
+class Grid<SimCellData>
+    : public GridBase<Grid<SimCellData>, SimCellData> {
+
+public:
+  /*
+   * Storage of the pheromone levels: floats in [0, 1], or 16-bit fixed-point
+   * levels in [0, FIXED_ONE] standing for multiples of 1 / FIXED_ONE.
+   */
+  enum Precision { FLOAT, FIXED16 };
+
+  /*
+   * Fixed-point level standing for a pheromone level of 1.
+   */
+  static constexpr int FIXED_ONE = UINT16_MAX;
+
+  /*
+   * Widest halo a grid can be surrounded with.
+   */
+  static constexpr int MAX_HALO = 8;
+
+  /*
+   *  Returns true if a grid with `rows` rows and `cols` columns can be
+   *  created, that is if its planes, with a halo up to MAX_HALO wide, can be
+   *  indexed with ints.
+   */
+  static bool fits(int rows, int cols) {
+    long long side = 2 * MAX_HALO;
+    return rows >= 0 && cols >= 0 && (rows + side) * (cols + side) <= INT_MAX;
+  }
+
+  /*
+   *  Creates a grid with the specified number of rows and columns. Throws if
+   *  the grid is too large, see `fits`.
+   */
+  Grid(int rows = 0, int cols = 0) : GridBase(rows, cols) { allocate(); }
+
+  /*
+   *  Resizes the grid to be `rows` tall and `cols` wide.
+   *  All contents are discarded. Throws if the grid is too large, see `fits`.
+   */
+  void resize(int rows, int cols) {
+    setDimensions(rows, cols);
+    allocate();
+  }
+
+  /*
+   *  Returns the width of the halo around the grid, in cells.
+   */
+  int getHalo() const { return m_halo; }
+
+  /*
+   *  Surrounds the grid with a halo `halo` cells wide, keeping its cells.
+   *  Halo cells are rock without pheromones, and must be kept so, as passes
+   *  over the rows of the grid skip them.
+   */
+  void setHalo(int halo) {
+    if (halo < 0 || halo > MAX_HALO)
+      throw std::invalid_argument("The halo width must be between 0 and "
+                                  "MAX_HALO.");
+
+    if (halo == m_halo)
+      return;
+
+    Grid<SimCellData> padded;
+    padded.m_halo = halo;
+    padded.m_precision = m_precision;
+    padded.resize(m_rows, m_cols);
+
+    for (int y = 0; y < m_rows; y++) {
+      std::ranges::copy(getTypeRow(y), padded.getTypeRow(y).begin());
+      if (m_precision == FIXED16) {
+        std::ranges::copy(getHomeLevelRow(y),
+                          padded.getHomeLevelRow(y).begin());
+        std::ranges::copy(getFoodLevelRow(y),
+                          padded.getFoodLevelRow(y).begin());
+      } else {
+        std::ranges::copy(getHomePheromoneRow(y),
+                          padded.getHomePheromoneRow(y).begin());
+        std::ranges::copy(getFoodPheromoneRow(y),
+                          padded.getFoodPheromoneRow(y).begin());
+      }
+    }
+
+    *this = std::move(padded);
+  }
+
+  /*
+   *  Returns the number of cells per row of the planes, halo included.
+   */
+  int getStride() const { return m_stride; }
+
+  /*
+   *  Returns the number of cells of the planes, halo included.
+   */
+  int getPlaneSize() const { return (m_rows + 2 * m_halo) * m_stride; }
+
+  /*
+   *  Returns the storage of the pheromone levels.
+   */
+  Precision getPrecision() const { return m_precision; }
+
+  /*
+   *  Stores the pheromone levels with precision `precision`, converting the
+   *  current levels to the nearest representable ones.
+   */
+  void setPrecision(Precision precision) {
+    if (precision == m_precision)
+      return;
+
+    if (precision == FIXED16) {
+      m_homeLevels.resize(getPlaneSize());
+      m_foodLevels.resize(getPlaneSize());
+      std::ranges::transform(m_homePheromone, m_homeLevels.begin(), toFixed);
+      std::ranges::transform(m_foodPheromone, m_foodLevels.begin(), toFixed);
+      std::vector<float>().swap(m_homePheromone);
+      std::vector<float>().swap(m_foodPheromone);
+    } else {
+      m_homePheromone.resize(getPlaneSize());
+      m_foodPheromone.resize(getPlaneSize());
+      std::ranges::transform(m_homeLevels, m_homePheromone.begin(), toFloat);
+      std::ranges::transform(m_foodLevels, m_foodPheromone.begin(), toFloat);
+      std::vector<uint16_t>().swap(m_homeLevels);
+      std::vector<uint16_t>().swap(m_foodLevels);
+    }
+
+    m_precision = precision;
+  }
+
+  /*
+   *  Returns the fixed-point level nearest to pheromone level `level`,
+   *  clamped to [0, 1].
+   */
+  static uint16_t toFixed(float level) {
+    return std::lrint(std::clamp(level, 0.0f, 1.0f) * FIXED_ONE);
+  }
+
+  /*
+   *  Returns the pheromone level of fixed-point level `level`.
+   */
+  static float toFloat(uint16_t level) {
+    return static_cast<float>(level) / FIXED_ONE;
+  }
+
+  /*
+   *  Sets the cell at column `x` and row `y` to `val`.
+   */
+  void setCell(int x, int y, SimCellData val) {
+    if (!areValid(x, y))
+      throw std::invalid_argument("Out of bounds coordinates.");
+
+    int i = indexOf(x, y);
+    m_types[i] = static_cast<uint8_t>(val.getType());
+    if (m_precision == FIXED16) {
+      m_homeLevels[i] = toFixed(val.getHomePheromone());
+      m_foodLevels[i] = toFixed(val.getFoodPheromone());
+    } else {
+      m_homePheromone[i] = val.getHomePheromone();
+      m_foodPheromone[i] = val.getFoodPheromone();
+    }
+  }
+
+  /*
+   *  Returns the i-th cell in row-major order.
+   */
+  Cell<SimCellData> getCell(int i) const {
+    if (i < 0 || i >= getSize())
+      throw std::invalid_argument("Out of bounds coordinates.");
+
+    int x = i % m_cols;
+    int y = i / m_cols;
+    return Cell<SimCellData>(x, y, getData(indexOf(x, y)));
+  }
+
+  /*
+   *  Returns the cell at column `x` and row `y`.
+   */
+  Cell<SimCellData> getCell(int x, int y) const {
+    if (!areValid(x, y))
+      throw std::invalid_argument("Out of bounds coordinates.");
+
+    return Cell<SimCellData>(x, y, getData(indexOf(x, y)));
+  }
+
+  /*
+   *  Returns the index of the cell at column `x` and row `y` in the planes.
+   *  Bounds are only checked in debug builds.
+   */
+  int indexOf(int x, int y) const {
+    assert(areValid(x, y));
+    return (y + m_halo) * m_stride + x + m_halo;
+  }
+
+  /*
+   *  Returns the difference between the index of any cell and the index of
+   *  the cell `dx` columns and `dy` rows away from it, which may lie in the
+   *  halo.
+   */
+  int offsetOf(int dx, int dy) const { return dy * m_stride + dx; }
+
+  /*
+   *  Returns a reference to the type of the i-th cell. Bounds are only
+   *  checked in debug builds.
+   */
+  uint8_t &typeAt(int i) {
+    assert(i >= 0 && i < getPlaneSize());
+    return m_types[i];
+  }
+  uint8_t typeAt(int i) const {
+    assert(i >= 0 && i < getPlaneSize());
+    return m_types[i];
+  }
+
+  /*
+   *  Returns a reference to the home pheromone level of the i-th cell.
+   *  Bounds are only checked in debug builds.
+   */
+  float &homePheromoneAt(int i) {
+    assert(i >= 0 && i < getPlaneSize() && m_precision == FLOAT);
+    return m_homePheromone[i];
+  }
+  float homePheromoneAt(int i) const {
+    assert(i >= 0 && i < getPlaneSize() && m_precision == FLOAT);
+    return m_homePheromone[i];
+  }
+
+  /*
+   *  Returns a reference to the food pheromone level of the i-th cell.
+   *  Bounds are only checked in debug builds.
+   */
+  float &foodPheromoneAt(int i) {
+    assert(i >= 0 && i < getPlaneSize() && m_precision == FLOAT);
+    return m_foodPheromone[i];
+  }
+  float foodPheromoneAt(int i) const {
+    assert(i >= 0 && i < getPlaneSize() && m_precision == FLOAT);
+    return m_foodPheromone[i];
+  }
+
+  /*
+   *  Returns a reference to the fixed-point home pheromone level of the i-th
+   *  cell. Bounds are only checked in debug builds.
+   */
+  uint16_t &homeLevelAt(int i) {
+    assert(i >= 0 && i < getPlaneSize() && m_precision == FIXED16);
+    return m_homeLevels[i];
+  }
+
+  /*
+   *  Returns a reference to the fixed-point food pheromone level of the i-th
+   *  cell. Bounds are only checked in debug builds.
+   */
+  uint16_t &foodLevelAt(int i) {
+    assert(i >= 0 && i < getPlaneSize() && m_precision == FIXED16);
+    return m_foodLevels[i];
+  }
+
+  /*
+   *  Returns the cell types of row `y`. Bounds are only checked in debug
+   *  builds.
+   */
+  std::span<uint8_t> getTypeRow(int y) {
+    return getTypePlane().subspan(rowOffset(y), m_cols);
+  }
+  std::span<const uint8_t> getTypeRow(int y) const {
+    return getTypePlane().subspan(rowOffset(y), m_cols);
+  }
+
+  /*
+   *  Returns the home pheromone levels of row `y`. Bounds are only checked in
+   *  debug builds.
+   */
+  std::span<float> getHomePheromoneRow(int y) {
+    return getHomePheromonePlane().subspan(rowOffset(y), m_cols);
+  }
+  std::span<const float> getHomePheromoneRow(int y) const {
+    return getHomePheromonePlane().subspan(rowOffset(y), m_cols);
+  }
+
+  /*
+   *  Returns the food pheromone levels of row `y`. Bounds are only checked in
+   *  debug builds.
+   */
+  std::span<float> getFoodPheromoneRow(int y) {
+    return getFoodPheromonePlane().subspan(rowOffset(y), m_cols);
+  }
+  std::span<const float> getFoodPheromoneRow(int y) const {
+    return getFoodPheromonePlane().subspan(rowOffset(y), m_cols);
+  }
+
+  /*
+   *  Returns the fixed-point home pheromone levels of row `y`. Bounds are
+   *  only checked in debug builds.
+   */
+  std::span<uint16_t> getHomeLevelRow(int y) {
+    return std::span(m_homeLevels).subspan(rowOffset(y), m_cols);
+  }
+
+  /*
+   *  Returns the fixed-point food pheromone levels of row `y`. Bounds are
+   *  only checked in debug builds.
+   */
+  std::span<uint16_t> getFoodLevelRow(int y) {
+    return std::span(m_foodLevels).subspan(rowOffset(y), m_cols);
+  }
+
+  /*
+   *  Returns the cell types, one byte per cell in row-major order with
+   *  getStride() cells per row, halo included.
+   */
+  std::span<uint8_t> getTypePlane() { return m_types; }
+  std::span<const uint8_t> getTypePlane() const { return m_types; }
+
+  /*
+   *  Returns the home pheromone levels, laid out like the cell types.
+   */
+  std::span<float> getHomePheromonePlane() { return m_homePheromone; }
+  std::span<const float> getHomePheromonePlane() const {
+    return m_homePheromone;
+  }
+
+  /*
+   *  Returns the food pheromone levels, laid out like the cell types.
+   */
+  std::span<float> getFoodPheromonePlane() { return m_foodPheromone; }
+  std::span<const float> getFoodPheromonePlane() const {
+    return m_foodPheromone;
+  }
+
+private:
+  std::vector<uint8_t> m_types;       // Cell types
+  std::vector<float> m_homePheromone; // Home pheromone levels
+  std::vector<float> m_foodPheromone; // Food pheromone levels
+  std::vector<uint16_t> m_homeLevels; // Fixed-point home pheromone levels
+  std::vector<uint16_t> m_foodLevels; // Fixed-point food pheromone levels
+  Precision m_precision = FLOAT;      // Storage of the pheromone levels
+  int m_halo = 0;                     // Width of the halo, in cells
+  int m_stride;                       // Cells per row, halo included
+
+  /*
+   *  Allocates the planes for the current dimensions, with every cell set to
+   *  an empty floor and every halo cell to rock.
+   */
+  void allocate() {
+    if (!fits(m_rows, m_cols))
+      throw std::invalid_argument("The grid is too large.");
+
+    m_stride = m_cols + 2 * m_halo;
+    if (m_halo == 0) {
+      m_types.assign(getPlaneSize(), static_cast<uint8_t>(SimCellData::FLOOR));
+    } else {
+      m_types.assign(getPlaneSize(), static_cast<uint8_t>(SimCellData::ROCK));
+      for (int y = 0; y < m_rows; y++)
+        std::ranges::fill(getTypeRow(y),
+                          static_cast<uint8_t>(SimCellData::FLOOR));
+    }
+
+    if (m_precision == FIXED16) {
+      m_homeLevels.assign(getPlaneSize(), 0);
+      m_foodLevels.assign(getPlaneSize(), 0);
+    } else {
+      m_homePheromone.assign(getPlaneSize(), 0.0f);
+      m_foodPheromone.assign(getPlaneSize(), 0.0f);
+    }
+  }
+
+  /*
+   *  Returns the index of the first cell of row `y`.
+   */
+  int rowOffset(int y) const {
+    assert(y >= 0 && y < m_rows);
+    return (y + m_halo) * m_stride + m_halo;
+  }
+
+  /*
+   *  Gathers the data of the i-th cell from the planes.
+   */
+  SimCellData getData(int i) const {
+    if (m_precision == FIXED16)
+      return SimCellData(static_cast<SimCellData::Type>(m_types[i]),
+                         toFloat(m_homeLevels[i]), toFloat(m_foodLevels[i]));
+
+    return SimCellData(static_cast<SimCellData::Type>(m_types[i]),
+                       m_homePheromone[i], m_foodPheromone[i]);
+  }
+};
+
+#endif // SIM_GRID_H
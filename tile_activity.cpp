@@ -0,0 +1,52 @@
+#include "tile_activity.h"
+#include <algorithm>
+#include <bit>
+
+TileActivity::TileActivity(int rows, int cols)
+    : m_rows(rows), m_cols(cols),
+      m_tileRows((rows + TILE_SIZE - 1) / TILE_SIZE),
+      m_tileCols((cols + TILE_SIZE - 1) / TILE_SIZE) {
+  size_t words = (static_cast<size_t>(getTileCount()) + 63) / 64;
+  m_active.assign(words, 0);
+  m_dirty.assign(words, 0);
+}
+
+TileActivity::Tile TileActivity::getTile(int tile) const {
+  int x0 = (tile % m_tileCols) * TILE_SIZE;
+  int y0 = (tile / m_tileCols) * TILE_SIZE;
+
+  return {x0, y0, std::min(x0 + TILE_SIZE, m_cols),
+          std::min(y0 + TILE_SIZE, m_rows)};
+}
+
+void TileActivity::markActive(Tile area) {
+  int x0 = std::max(area.x0, 0) / TILE_SIZE;
+  int y0 = std::max(area.y0, 0) / TILE_SIZE;
+  int x1 = (std::min(area.x1, m_cols) + TILE_SIZE - 1) / TILE_SIZE;
+  int y1 = (std::min(area.y1, m_rows) + TILE_SIZE - 1) / TILE_SIZE;
+
+  for (int y = y0; y < y1; y++) {
+    for (int x = x0; x < x1; x++) {
+      setBit(m_active, y * m_tileCols + x);
+      setBit(m_dirty, y * m_tileCols + x);
+    }
+  }
+}
+
+std::vector<int> TileActivity::takeDirtyTiles() {
+  std::vector<int> tiles = listBits(m_dirty);
+  std::fill(m_dirty.begin(), m_dirty.end(), 0);
+  return tiles;
+}
+
+std::vector<int> TileActivity::listBits(const std::vector<uint64_t> &bits) {
+  std::vector<int> tiles;
+
+  // Only the set bits are visited, so idle words cost a single test
+  for (size_t w = 0; w < bits.size(); w++) {
+    for (uint64_t word = bits[w]; word != 0; word &= word - 1)
+      tiles.push_back(static_cast<int>(w * 64) + std::countr_zero(word));
+  }
+
+  return tiles;
+}
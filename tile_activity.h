@@ -0,0 +1,115 @@
+#ifndef TILE_ACTIVITY_H
+#define TILE_ACTIVITY_H
+
+#include "tile_frontier.h"
+#include <cstdint>
+#include <vector>
+
+/*
+ * Tracks which square tiles of the simulation grid are active, meaning they
+ * may hold pheromones or population, and which are dirty, meaning they
+ * changed since they were last drawn. Both are kept as bitmaps with one bit
+ * per tile, so that passes over the grid only visit the tiles they need.
+ */
+class TileActivity {
+
+public:
+  /*
+   * Side of a tile, in cells.
+   */
+  static const int TILE_SIZE = 32;
+
+  /*
+   * Bounds of a tile: columns [x0, x1) and rows [y0, y1).
+   */
+  using Tile = TileFrontier::Tile;
+
+  /*
+   *  Creates the bitmaps for a grid with `rows` rows and `cols` columns,
+   *  with no tile active or dirty.
+   */
+  TileActivity(int rows = 0, int cols = 0);
+
+  /*
+   *  Returns the number of tiles.
+   */
+  int getTileCount() const { return m_tileRows * m_tileCols; }
+
+  /*
+   *  Returns the bounds of the tile with index `tile`.
+   */
+  Tile getTile(int tile) const;
+
+  /*
+   *  Marks the tile holding the cell at column `x` and row `y` as active and
+   *  dirty.
+   */
+  void markActive(int x, int y) {
+    int tile = (y / TILE_SIZE) * m_tileCols + x / TILE_SIZE;
+    setBit(m_active, tile);
+    setBit(m_dirty, tile);
+  }
+
+  /*
+   *  Marks the tiles overlapping `area` as active and dirty. Parts of `area`
+   *  outside the grid are ignored.
+   */
+  void markActive(Tile area);
+
+  /*
+   *  Marks the tile with index `tile` as dirty.
+   */
+  void markDirty(int tile) { setBit(m_dirty, tile); }
+
+  /*
+   *  Marks the tile with index `tile` as clean.
+   */
+  void markClean(int tile) {
+    m_dirty[tile / 64] &= ~(uint64_t(1) << (tile % 64));
+  }
+
+  /*
+   *  Marks the tile with index `tile` as inactive.
+   */
+  void deactivate(int tile) {
+    m_active[tile / 64] &= ~(uint64_t(1) << (tile % 64));
+  }
+
+  /*
+   *  Returns the indices of the active tiles, in increasing order.
+   */
+  std::vector<int> getActiveTiles() const { return listBits(m_active); }
+
+  /*
+   *  Returns the indices of the dirty tiles, in increasing order.
+   */
+  std::vector<int> getDirtyTiles() const { return listBits(m_dirty); }
+
+  /*
+   *  Returns the indices of the dirty tiles, in increasing order, and marks
+   *  every tile as clean.
+   */
+  std::vector<int> takeDirtyTiles();
+
+private:
+  int m_rows;                     // Number of grid rows
+  int m_cols;                     // Number of grid columns
+  int m_tileRows;                 // Number of tile rows
+  int m_tileCols;                 // Number of tile columns
+  std::vector<uint64_t> m_active; // Active tiles, one bit each
+  std::vector<uint64_t> m_dirty;  // Dirty tiles, one bit each
+
+  /*
+   *  Sets the bit of the tile with index `tile` in `bits`.
+   */
+  static void setBit(std::vector<uint64_t> &bits, int tile) {
+    bits[tile / 64] |= uint64_t(1) << (tile % 64);
+  }
+
+  /*
+   *  Returns the indices of the tiles whose bits are set in `bits`.
+   */
+  static std::vector<int> listBits(const std::vector<uint64_t> &bits);
+};
+
+#endif // TILE_ACTIVITY_H
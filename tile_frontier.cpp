@@ -0,0 +1,58 @@
+#include "tile_frontier.h"
+#include <algorithm>
+
+TileFrontier::TileFrontier(int rows, int cols, int radius)
+    : m_rows(rows), m_cols(cols),
+      m_tileRows((rows + TILE_SIZE - 1) / TILE_SIZE),
+      m_tileCols((cols + TILE_SIZE - 1) / TILE_SIZE) {
+  // Radii past the extent of the grid all reach the same tiles
+  radius = std::clamp(radius, 0, rows + cols);
+  m_reach = (radius + TILE_SIZE - 1) / TILE_SIZE;
+
+  m_changed.assign(static_cast<size_t>(m_tileRows) * m_tileCols, 1);
+}
+
+const std::vector<int> &TileFrontier::advance() {
+  // Count the changed tiles above and to the left of each tile corner, so
+  // that each tile can check its surroundings in constant time
+  int stride = m_tileCols + 1;
+  std::vector<int> sums(static_cast<size_t>(m_tileRows + 1) * stride, 0);
+  for (int ty = 0; ty < m_tileRows; ty++) {
+    int rowSum = 0;
+    for (int tx = 0; tx < m_tileCols; tx++) {
+      rowSum += m_changed[ty * m_tileCols + tx];
+      sums[(ty + 1) * stride + tx + 1] = sums[ty * stride + tx + 1] + rowSum;
+    }
+  }
+
+  m_active.clear();
+  for (int ty = 0; ty < m_tileRows; ty++) {
+    int y0 = std::max(ty - m_reach, 0);
+    int y1 = std::min(ty + m_reach, m_tileRows - 1) + 1;
+
+    for (int tx = 0; tx < m_tileCols; tx++) {
+      int x0 = std::max(tx - m_reach, 0);
+      int x1 = std::min(tx + m_reach, m_tileCols - 1) + 1;
+
+      int nearby = sums[y1 * stride + x1] - sums[y0 * stride + x1] -
+                   sums[y1 * stride + x0] + sums[y0 * stride + x0];
+      if (nearby > 0)
+        m_active.push_back(ty * m_tileCols + tx);
+    }
+  }
+
+  std::fill(m_changed.begin(), m_changed.end(), 0);
+  return m_active;
+}
+
+bool TileFrontier::anyChanged() const {
+  return std::find(m_changed.begin(), m_changed.end(), 1) != m_changed.end();
+}
+
+TileFrontier::Tile TileFrontier::getTile(int tile) const {
+  int x0 = (tile % m_tileCols) * TILE_SIZE;
+  int y0 = (tile / m_tileCols) * TILE_SIZE;
+
+  return {x0, y0, std::min(x0 + TILE_SIZE, m_cols),
+          std::min(y0 + TILE_SIZE, m_rows)};
+}
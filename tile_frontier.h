@@ -0,0 +1,70 @@
+#ifndef TILE_FRONTIER_H
+#define TILE_FRONTIER_H
+
+#include <cstdint>
+#include <vector>
+
+/*
+ * Tracks which square tiles of a grid changed during the last step of a
+ * cellular automaton, so that the next step only re-evaluates the tiles
+ * within reach of a change.
+ */
+class TileFrontier {
+
+public:
+  /*
+   * Side of a tile, in cells. Tiles are one word wide in a BitGrid.
+   */
+  static const int TILE_SIZE = 64;
+
+  /*
+   * Bounds of a tile: columns [x0, x1) and rows [y0, y1).
+   */
+  struct Tile {
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+  };
+
+  /*
+   *  Creates a frontier for a grid with `rows` rows and `cols` columns,
+   *  evolved with a neighbourhood of radius `radius`. Initially every tile
+   *  counts as changed.
+   */
+  TileFrontier(int rows, int cols, int radius);
+
+  /*
+   *  Starts a new step. Returns the indices of the tiles to evaluate, which
+   *  are those within reach of a tile that changed in the previous step, and
+   *  forgets the previous changes.
+   */
+  const std::vector<int> &advance();
+
+  /*
+   *  Records that the tile with index `tile` changed in the current step.
+   *  Different tiles may be marked concurrently.
+   */
+  void markChanged(int tile) { m_changed[tile] = 1; }
+
+  /*
+   *  Returns true if any tile changed in the current step.
+   */
+  bool anyChanged() const;
+
+  /*
+   *  Returns the bounds of the tile with index `tile`.
+   */
+  Tile getTile(int tile) const;
+
+private:
+  int m_rows;                     // Number of grid rows
+  int m_cols;                     // Number of grid columns
+  int m_tileRows;                 // Number of tile rows
+  int m_tileCols;                 // Number of tile columns
+  int m_reach;                    // Reach of a change, in tiles
+  std::vector<uint8_t> m_changed; // Tiles changed in the current step
+  std::vector<int> m_active;      // Tiles to evaluate in the current step
+};
+
+#endif // TILE_FRONTIER_H
@@ -0,0 +1,140 @@
+#include "value_noise.h"
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+/*
+ * Mixes the bits of `h` so that every input bit affects every output bit,
+ * following the SplitMix64 finalizer.
+ */
+inline uint64_t mixBits(uint64_t h) {
+  h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+  h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+  return h ^ (h >> 31);
+}
+
+/*
+ * Adds `base + slope * weights[k]` to `values[k]` for the first `count`
+ * values, four at a time where SSE2 is available.
+ */
+inline void addRamp(float *values, const float *weights, int count,
+                    float base, float slope) {
+  int k = 0;
+
+#ifdef __SSE2__
+  __m128 bases = _mm_set1_ps(base);
+  __m128 slopes = _mm_set1_ps(slope);
+  for (; k + 4 <= count; k += 4) {
+    __m128 ramp = _mm_mul_ps(slopes, _mm_loadu_ps(weights + k));
+    ramp = _mm_add_ps(bases, ramp);
+    _mm_storeu_ps(values + k, _mm_add_ps(_mm_loadu_ps(values + k), ramp));
+  }
+#endif
+
+  for (; k < count; k++)
+    values[k] += base + slope * weights[k];
+}
+
+} // namespace
+
+ValueNoise::ValueNoise(int seed, int scale, int octaves) {
+  if (scale < 1 || octaves < 1)
+    throw std::invalid_argument(
+        "Arguments do not fall in the required ranges.");
+
+  // Octaves past a period of one cell would only add white noise
+  float total = 0.0f;
+  for (int o = 0; o < octaves && (o == 0 || (scale >> (o - 1)) > 1); o++) {
+    Octave octave;
+    octave.seed =
+        static_cast<uint32_t>(seed) + (static_cast<uint64_t>(o + 1) << 32);
+    octave.period = std::max(1, scale >> o);
+    octave.amplitude = 1.0f / (1 << o);
+
+    // Smoothstep weights flatten the noise around the lattice points
+    for (int k = 0; k < octave.period; k++) {
+      float t = static_cast<float>(k) / octave.period;
+      octave.weights.push_back(t * t * (3.0f - 2.0f * t));
+    }
+
+    total += octave.amplitude;
+    m_octaves.push_back(std::move(octave));
+  }
+
+  for (Octave &octave : m_octaves)
+    octave.amplitude /= total;
+}
+
+void ValueNoise::sampleRow(int y, int x0, std::span<float> values,
+                           RowCache &cache) const {
+  assert(y >= 0 && x0 >= 0);
+  std::ranges::fill(values, 0.0f);
+  long long x1 = static_cast<long long>(x0) + values.size();
+
+  if (cache.m_rows.size() != m_octaves.size()) {
+    cache.m_rows.assign(m_octaves.size(), -1);
+    cache.m_firstColumns.assign(m_octaves.size(), -1);
+    cache.m_top.resize(m_octaves.size());
+    cache.m_bottom.resize(m_octaves.size());
+  }
+
+  for (size_t o = 0; o < m_octaves.size(); o++) {
+    const Octave &octave = m_octaves[o];
+    int period = octave.period;
+    int j = y / period;
+    int i0 = x0 / period;
+    int columns = static_cast<int>((x1 - 1) / period) - i0 + 2;
+    std::vector<float> &top = cache.m_top[o];
+    std::vector<float> &bottom = cache.m_bottom[o];
+
+    if (cache.m_rows[o] != j || cache.m_firstColumns[o] != i0 ||
+        static_cast<int>(top.size()) != columns) {
+      top.resize(columns);
+      bottom.resize(columns);
+      for (int i = 0; i < columns; i++) {
+        top[i] = latticeValue(octave, i0 + i, j);
+        bottom[i] = latticeValue(octave, i0 + i, j + 1);
+      }
+      cache.m_rows[o] = j;
+      cache.m_firstColumns[o] = i0;
+    }
+
+    // Lattice columns are interpolated vertically, then each span of cells
+    // between two of them is a linear ramp in the weights
+    float fy = octave.weights[y % period];
+    auto column = [&](int i) {
+      return octave.amplitude * (top[i] + (bottom[i] - top[i]) * fy);
+    };
+
+    float left = column(0);
+    long long x = x0;
+    for (int i = 0; x < x1; i++) {
+      long long start = static_cast<long long>(i0 + i) * period;
+      long long end = std::min(x1, start + period);
+      float right = column(i + 1);
+
+      addRamp(values.data() + (x - x0), octave.weights.data() + (x - start),
+              end - x, left, right - left);
+
+      left = right;
+      x = end;
+    }
+  }
+}
+
+uint64_t ValueNoise::hash(uint64_t seed, int x, int y) {
+  uint64_t h = mixBits(seed + 0x9E3779B97F4A7C15ull);
+  h = mixBits(h ^ static_cast<uint32_t>(x));
+  return mixBits(h ^ (static_cast<uint64_t>(static_cast<uint32_t>(y)) << 32));
+}
+
+float ValueNoise::latticeValue(const Octave &octave, int i, int j) {
+  // The top 24 bits fill the mantissa of a float in [0, 1) exactly
+  return static_cast<float>(hash(octave.seed, i, j) >> 40) * 0x1p-24f;
+}
@@ -0,0 +1,75 @@
+#ifndef VALUE_NOISE_H
+#define VALUE_NOISE_H
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/*
+ * Fractal value noise: the sum of several octaves of random values placed on
+ * square lattices of decreasing period, smoothly interpolated in between.
+ * Values only depend on the seed and the cell coordinates, so any part of
+ * the plane can be sampled on its own.
+ */
+class ValueNoise {
+
+public:
+  /*
+   *  Creates the noise for seed `seed` whose first octave has lattice period
+   *  `scale`, in cells. Each of the `octaves` octaves halves the period and
+   *  the amplitude of the previous one, down to a period of one cell.
+   */
+  ValueNoise(int seed, int scale, int octaves);
+
+  /*
+   * Lattice values of the last rows sampled, which nearby rows share. Each
+   * thread sampling rows needs its own.
+   */
+  class RowCache {
+    friend class ValueNoise;
+
+    std::vector<int> m_rows;                  // Lattice row of each octave
+    std::vector<int> m_firstColumns;          // First lattice column
+    std::vector<std::vector<float>> m_top;    // Values on the lattice rows
+    std::vector<std::vector<float>> m_bottom; // Values on the rows below
+  };
+
+  /*
+   *  Stores in `values` the noise at row `y` and the columns starting at
+   *  `x0`, each in [0, 1). Coordinates must not be negative. Lattice values
+   *  are looked up in `cache` first, so sampling consecutive rows with the
+   *  same cache only hashes the lattice once per lattice row.
+   */
+  void sampleRow(int y, int x0, std::span<float> values,
+                 RowCache &cache) const;
+  void sampleRow(int y, int x0, std::span<float> values) const {
+    RowCache cache;
+    sampleRow(y, x0, values, cache);
+  }
+
+  /*
+   *  Returns a pseudo-random value for column `x` and row `y` of the plane
+   *  with seed `seed`, which only depends on these three values.
+   */
+  static uint64_t hash(uint64_t seed, int x, int y);
+
+private:
+  /*
+   * Lattice of one octave.
+   */
+  struct Octave {
+    uint64_t seed;              // Seed of the lattice values
+    int period;                 // Distance between lattice points, in cells
+    float amplitude;            // Weight of the octave in the sum
+    std::vector<float> weights; // Interpolation weights within a period
+  };
+
+  std::vector<Octave> m_octaves; // Octaves, from the coarsest
+
+  /*
+   *  Returns the value of lattice point (`i`, `j`) of `octave`, in [0, 1).
+   */
+  static float latticeValue(const Octave &octave, int i, int j);
+};
+
+#endif // VALUE_NOISE_H